@@ -0,0 +1,1054 @@
+/*
+Copyright 2023 Ivor Wanders
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the author nor the names of contributors may be used to
+  endorse or promote products derived from this software without specific
+  prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory_resource>
+#include <new>
+#include <numeric>
+#include <random>
+#include <ranges>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "rust_cpp_iterator.hpp"
+#if defined(__unix__) || defined(__APPLE__)
+#include "rust_cpp_io.hpp"
+#include "rust_cpp_mmap.hpp"
+#endif
+
+// Usage: bench_iterators [--min N] [--max N] [--min-time SECONDS] [--filter SUBSTRING]
+// Sizes go in decades from --min (default 1000, at least 1) to --max (default 100000000), every benchmark
+// reports the best ns per element and the bytes / allocations made by a single run.
+
+namespace
+{
+std::atomic<std::size_t> allocated_bytes{ 0 };
+std::atomic<std::size_t> allocation_count{ 0 };
+}  // namespace
+
+// Count every allocation made through the global operator new, that way we can report what a
+// pipeline allocates behind our back.
+void* operator new(std::size_t size)
+{
+  allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size == 0 ? 1 : size))
+  {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+void* operator new[](std::size_t size)
+{
+  return operator new(size);
+}
+void* operator new(std::size_t size, std::align_val_t align)
+{
+  allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  const auto a = static_cast<std::size_t>(align);
+  if (void* p = std::aligned_alloc(a, ((size + a - 1) / a) * a))
+  {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+void* operator new[](std::size_t size, std::align_val_t align)
+{
+  return operator new(size, align);
+}
+// GCC pairs the std::free calls below with the operator new the library sees, not with the malloc
+// and aligned_alloc behind our replacements, and warns about a mismatch that isn't there.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+void operator delete[](void* p) noexcept
+{
+  std::free(p);
+}
+void operator delete(void* p, std::size_t) noexcept
+{
+  std::free(p);
+}
+void operator delete[](void* p, std::size_t) noexcept
+{
+  std::free(p);
+}
+void operator delete(void* p, std::align_val_t) noexcept
+{
+  std::free(p);
+}
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+  std::free(p);
+}
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{
+  std::free(p);
+}
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept
+{
+  std::free(p);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+namespace
+{
+using rust::u32;
+using rust::u64;
+using rust::usize;
+
+template <typename T>
+void do_not_optimize(const T& v)
+{
+  asm volatile("" : : "r,m"(v) : "memory");
+}
+
+/// Swallows anything written to std::cout while a benchmark runs, the library may log.
+struct SilenceCout
+{
+  SilenceCout() : old_(std::cout.rdbuf(&null_))
+  {
+  }
+  ~SilenceCout()
+  {
+    std::cout.rdbuf(old_);
+  }
+
+private:
+  struct NullBuf : std::streambuf
+  {
+    int overflow(int c) override
+    {
+      return c;
+    }
+    std::streamsize xsputn(const char*, std::streamsize n) override
+    {
+      return n;
+    }
+  };
+  NullBuf null_;
+  std::streambuf* old_;
+};
+
+struct Config
+{
+  usize min_n = 1000;
+  usize max_n = 100'000'000;
+  double min_time = 0.25;
+  std::string filter;
+};
+
+struct Measurement
+{
+  double ns_per_element;
+  std::size_t bytes;
+  std::size_t allocations;
+};
+
+/// Run setup() + body() until min_time is spent in body(), report the fastest run.
+template <typename Setup, typename Body>
+Measurement measure(const Config& config, usize n, Setup&& setup, Body&& body)
+{
+  using clock = std::chrono::steady_clock;
+  double best = std::numeric_limits<double>::max();
+  double total = 0.0;
+  std::size_t bytes = 0;
+  std::size_t allocations = 0;
+  usize runs = 0;
+  while (runs == 0 || total < config.min_time)
+  {
+    auto input = setup();
+    const auto bytes_before = allocated_bytes.load();
+    const auto allocations_before = allocation_count.load();
+    const auto start = clock::now();
+    {
+      SilenceCout silence;
+      body(input);
+    }
+    const auto end = clock::now();
+    bytes = allocated_bytes.load() - bytes_before;
+    allocations = allocation_count.load() - allocations_before;
+    const double duration = std::chrono::duration<double>(end - start).count();
+    best = std::min(best, duration);
+    total += duration;
+    runs++;
+  }
+  return Measurement{ best * 1e9 / static_cast<double>(n), bytes, allocations };
+}
+
+void report(const std::string& name, const std::string& variant, usize n, const Measurement& m)
+{
+  std::printf("%-12s %-14s %12zu %12.3f %14zu %8zu\n", name.c_str(), variant.c_str(), n, m.ns_per_element, m.bytes,
+              m.allocations);
+  std::fflush(stdout);
+}
+
+std::vector<u32> random_values(usize n, u32 seed)
+{
+  std::mt19937 gen(seed);
+  std::uniform_int_distribution<u32> dist(0, 1'000'000);
+  std::vector<u32> v(n);
+  for (auto& x : v)
+  {
+    x = dist(gen);
+  }
+  return v;
+}
+
+struct Benchmark
+{
+  std::string name;
+  std::function<void(const Config&, usize)> run;
+};
+
+std::vector<Benchmark> benchmarks()
+{
+  std::vector<Benchmark> b;
+
+  b.push_back({ "map_sum", [](const Config& c, usize n)
+                {
+                  const auto v = random_values(n, 1);
+                  const auto none = [] { return 0; };
+                  report("map_sum", "rust::iter", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   u64 s = rust::iter(v).map([](const auto& x) { return u64{ *x } * *x; }).sum();
+                                   do_not_optimize(s);
+                                 }));
+                  report("map_sum", "par_iter", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   u64 s = rust::slice(v).par_iter().map([](const auto& x) { return u64{ *x } * *x; }).sum();
+                                   do_not_optimize(s);
+                                 }));
+                  report("map_sum", "raw loop", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   u64 s = 0;
+                                   for (usize i = 0; i < v.size(); i++)
+                                   {
+                                     s += u64{ v[i] } * v[i];
+                                   }
+                                   do_not_optimize(s);
+                                 }));
+                  report("map_sum", "std::ranges", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   u64 s = 0;
+                                   for (auto x : v | std::views::transform([](u32 x) { return u64{ x } * x; }))
+                                   {
+                                     s += x;
+                                   }
+                                   do_not_optimize(s);
+                                 }));
+                } });
+
+  b.push_back({ "enumerate", [](const Config& c, usize n)
+                {
+                  const auto v = random_values(n, 2);
+                  const auto none = [] { return 0; };
+                  report("enumerate", "rust::iter", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   u64 s = 0;
+                                   for (const auto& [i, x] : rust::iter(v).enumerate())
+                                   {
+                                     s += i ^ *x;
+                                   }
+                                   do_not_optimize(s);
+                                 }));
+                  report("enumerate", "raw loop", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   u64 s = 0;
+                                   for (usize i = 0; i < v.size(); i++)
+                                   {
+                                     s += i ^ v[i];
+                                   }
+                                   do_not_optimize(s);
+                                 }));
+                  report("enumerate", "std::ranges", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   u64 s = 0;
+                                   for (auto i : std::views::iota(usize{ 0 }, v.size()))
+                                   {
+                                     s += i ^ v[i];
+                                   }
+                                   do_not_optimize(s);
+                                 }));
+                } });
+
+  b.push_back({ "zip", [](const Config& c, usize n)
+                {
+                  const auto a = random_values(n, 3);
+                  const auto b = random_values(n, 4);
+                  const auto none = [] { return 0; };
+                  report("zip", "rust::iter", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   u64 s = rust::iter(a)
+                                               .zip(rust::iter(b))
+                                               .map(
+                                                   [](const auto& t)
+                                                   {
+                                                     const auto& [l, r] = t;
+                                                     return u64{ *l } * *r;
+                                                   })
+                                               .sum();
+                                   do_not_optimize(s);
+                                 }));
+                  report("zip", "raw loop", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   u64 s = 0;
+                                   for (usize i = 0; i < a.size(); i++)
+                                   {
+                                     s += u64{ a[i] } * b[i];
+                                   }
+                                   do_not_optimize(s);
+                                 }));
+                  report("zip", "std::ranges", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   // No std::views::zip before C++23, pair up through an index view.
+                                   u64 s = 0;
+                                   for (auto x : std::views::iota(usize{ 0 }, a.size()) |
+                                                     std::views::transform([&](usize i) { return u64{ a[i] } * b[i]; }))
+                                   {
+                                     s += x;
+                                   }
+                                   do_not_optimize(s);
+                                 }));
+                } });
+
+  b.push_back({ "collect", [](const Config& c, usize n)
+                {
+                  const auto v = random_values(n, 5);
+                  const auto none = [] { return 0; };
+                  report("collect", "rust::iter", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   auto r = rust::iter(v).copied().collect<std::vector<u32>>();
+                                   do_not_optimize(r.data());
+                                 }));
+                  // The arena's buffer is made once and released per run, no global allocations remain.
+                  std::vector<std::byte> buffer(n * sizeof(u32) + 64);
+                  std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size());
+                  report("collect", "collect_in arena", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   {
+                                     auto r = rust::iter(v).copied().collect_in(&arena);
+                                     do_not_optimize(r.as_ptr());
+                                   }
+                                   arena.release();
+                                 }));
+                  report("collect", "raw loop", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   std::vector<u32> r;
+                                   r.reserve(v.size());
+                                   for (usize i = 0; i < v.size(); i++)
+                                   {
+                                     r.push_back(v[i]);
+                                   }
+                                   do_not_optimize(r.data());
+                                 }));
+                  report("collect", "std::ranges", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   auto view = v | std::views::transform([](u32 x) { return x; });
+                                   std::vector<u32> r(view.begin(), view.end());
+                                   do_not_optimize(r.data());
+                                 }));
+                } });
+
+  b.push_back({ "collect_small", [](const Config& c, usize n)
+                {
+                  // Many collects of 12 values each, the size of a typical request handler result.
+                  constexpr usize piece = 12;
+                  const auto v = random_values(n - n % piece, 5);
+                  const auto none = [] { return 0; };
+                  report("collect_small", "std::vector", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   for (usize i = 0; i < v.size(); i += piece)
+                                   {
+                                     auto s = rust::slice(v)(i, i + piece);
+                                     auto r = s.iter().copied().collect<std::vector<u32>>();
+                                     do_not_optimize(r.data());
+                                   }
+                                 }));
+                  report("collect_small", "ArrayVec<16>", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   for (usize i = 0; i < v.size(); i += piece)
+                                   {
+                                     auto s = rust::slice(v)(i, i + piece);
+                                     auto r = s.iter().copied().collect<rust::ArrayVec<u32, 16>>();
+                                     do_not_optimize(r.as_ptr());
+                                   }
+                                 }));
+                  report("collect_small", "SmallVec<16>", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   for (usize i = 0; i < v.size(); i += piece)
+                                   {
+                                     auto s = rust::slice(v)(i, i + piece);
+                                     auto r = s.iter().copied().collect<rust::SmallVec<u32, 16>>();
+                                     do_not_optimize(r.as_ptr());
+                                   }
+                                 }));
+                } });
+
+  b.push_back({ "group_by", [](const Config& c, usize n)
+                {
+                  // Sum the values per key, with about four values per key.
+                  const auto v = random_values(n, 12);
+                  const u32 groups = static_cast<u32>(n / 4 + 1);
+                  const auto none = [] { return 0; };
+                  report("group_by", "rust::HashMap", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   rust::HashMap<u32, u64> sums;
+                                   for (const u32 x : v)
+                                   {
+                                     sums.entry(x % groups).or_insert(0) += x;
+                                   }
+                                   do_not_optimize(sums.len());
+                                 }));
+                  report("group_by", "std::unordered_map", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   std::unordered_map<u32, u64> sums;
+                                   for (const u32 x : v)
+                                   {
+                                     sums[x % groups] += x;
+                                   }
+                                   do_not_optimize(sums.size());
+                                 }));
+                } });
+
+  b.push_back({ "extend", [](const Config& c, usize n)
+                {
+                  // Append batches of 64 values to one buffer, like an ingest loop.
+                  constexpr usize piece = 64;
+                  const auto v = random_values(piece, 13);
+                  const usize batches = n / piece + 1;
+                  const auto none = [] { return 0; };
+                  report("extend", "collect_into", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   std::vector<u32> buffer;
+                                   for (usize i = 0; i < batches; i++)
+                                   {
+                                     rust::iter(v).collect_into(buffer);
+                                   }
+                                   do_not_optimize(buffer.data());
+                                 }));
+                  report("extend", "collect + insert", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   std::vector<u32> buffer;
+                                   for (usize i = 0; i < batches; i++)
+                                   {
+                                     auto tmp = rust::iter(v).copied().collect<std::vector<u32>>();
+                                     buffer.insert(buffer.end(), tmp.begin(), tmp.end());
+                                   }
+                                   do_not_optimize(buffer.data());
+                                 }));
+                  report("extend", "raw loop", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   std::vector<u32> buffer;
+                                   for (usize i = 0; i < batches; i++)
+                                   {
+                                     for (const u32 x : v)
+                                     {
+                                       buffer.push_back(x);
+                                     }
+                                   }
+                                   do_not_optimize(buffer.data());
+                                 }));
+                } });
+
+  b.push_back({ "drain", [](const Config& c, usize n)
+                {
+                  const auto v = random_values(n, 6);
+                  const auto copy = [&] { return v; };
+                  report("drain", "rust::drain", n,
+                         measure(c, n, copy,
+                                 [&](std::vector<u32>& input)
+                                 {
+                                   auto r = rust::drain(std::move(input)).collect<std::vector<u32>>();
+                                   do_not_optimize(r.data());
+                                 }));
+                  report("drain", "Vec::into_iter", n,
+                         measure(c, n, copy,
+                                 [&](std::vector<u32>& input)
+                                 {
+                                   rust::Vec<u32> owned(std::move(input));
+                                   auto r = std::move(owned).into_iter().collect<std::vector<u32>>();
+                                   do_not_optimize(r.data());
+                                 }));
+                  report("drain", "Vec::drain", n,
+                         measure(c, n, copy,
+                                 [&](std::vector<u32>& input)
+                                 {
+                                   rust::Vec<u32> owned(std::move(input));
+                                   auto r = owned.drain().collect<std::vector<u32>>();
+                                   do_not_optimize(r.data());
+                                 }));
+                  report("drain", "raw loop", n,
+                         measure(c, n, copy,
+                                 [&](std::vector<u32>& input)
+                                 {
+                                   std::vector<u32> r;
+                                   r.reserve(input.size());
+                                   for (auto& x : input)
+                                   {
+                                     r.push_back(std::move(x));
+                                   }
+                                   do_not_optimize(r.data());
+                                 }));
+                  report("drain", "std::ranges", n,
+                         measure(c, n, copy,
+                                 [&](std::vector<u32>& input)
+                                 {
+                                   std::vector<u32> r;
+                                   r.reserve(input.size());
+                                   std::ranges::move(input, std::back_inserter(r));
+                                   do_not_optimize(r.data());
+                                 }));
+                } });
+
+  b.push_back({ "sort", [](const Config& c, usize n)
+                {
+                  const auto v = random_values(n, 7);
+                  const auto copy = [&] { return v; };
+                  report("sort", "Slice::sort", n,
+                         measure(c, n, copy,
+                                 [&](std::vector<u32>& input)
+                                 {
+                                   rust::slice(input).sort();
+                                   do_not_optimize(input.data());
+                                 }));
+                  report("sort", "sort_unstable", n,
+                         measure(c, n, copy,
+                                 [&](std::vector<u32>& input)
+                                 {
+                                   rust::slice(input).sort_unstable();
+                                   do_not_optimize(input.data());
+                                 }));
+                  report("sort", "par_sort", n,
+                         measure(c, n, copy,
+                                 [&](std::vector<u32>& input)
+                                 {
+                                   rust::slice(input).par_sort();
+                                   do_not_optimize(input.data());
+                                 }));
+                  report("sort", "par_unstable", n,
+                         measure(c, n, copy,
+                                 [&](std::vector<u32>& input)
+                                 {
+                                   rust::slice(input).par_sort_unstable();
+                                   do_not_optimize(input.data());
+                                 }));
+                  report("sort", "radix_sort", n,
+                         measure(c, n, copy,
+                                 [&](std::vector<u32>& input)
+                                 {
+                                   rust::slice(input).radix_sort();
+                                   do_not_optimize(input.data());
+                                 }));
+                  report("sort", "std::sort", n,
+                         measure(c, n, copy,
+                                 [&](std::vector<u32>& input)
+                                 {
+                                   std::sort(input.begin(), input.end());
+                                   do_not_optimize(input.data());
+                                 }));
+                  report("sort", "std::ranges", n,
+                         measure(c, n, copy,
+                                 [&](std::vector<u32>& input)
+                                 {
+                                   std::ranges::sort(input);
+                                   do_not_optimize(input.data());
+                                 }));
+                } });
+
+  b.push_back({ "find", [](const Config& c, usize n)
+                {
+                  // Search for a value that is not present, scanning the whole slice.
+                  const auto v = random_values(n, 8);
+                  const u32 needle = 2'000'000;
+                  const auto none = [] { return 0; };
+                  report("find", "Slice::position", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   auto r = rust::slice(v).position(needle);
+                                   do_not_optimize(r);
+                                 }));
+                  report("find", "raw loop", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   usize r = v.size();
+                                   for (usize i = 0; i < v.size(); i++)
+                                   {
+                                     if (v[i] == needle)
+                                     {
+                                       r = i;
+                                       break;
+                                     }
+                                   }
+                                   do_not_optimize(r);
+                                 }));
+                  report("find", "std::ranges", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   auto r = std::ranges::find(v, needle);
+                                   do_not_optimize(r);
+                                 }));
+                } });
+
+  b.push_back({ "filter_flatten", [](const Config& c, usize n)
+                {
+                  // Sum the even values of rows of 64, through filter and flatten instead of a copy.
+                  const auto flat = random_values(n, 10);
+                  std::vector<std::vector<u32>> rows;
+                  for (usize i = 0; i < flat.size(); i += 64)
+                  {
+                    rows.emplace_back(flat.begin() + i, flat.begin() + std::min(flat.size(), i + 64));
+                  }
+                  const auto none = [] { return 0; };
+                  report("filter_flatten", "rust::iter", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   u64 s = rust::iter(rows)
+                                               .flatten()
+                                               .filter([](const auto& x) { return *x % 2 == 0; })
+                                               .map([](const auto& x) { return u64{ *x }; })
+                                               .sum();
+                                   do_not_optimize(s);
+                                 }));
+                  report("filter_flatten", "raw loop", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   u64 s = 0;
+                                   for (const auto& row : rows)
+                                   {
+                                     for (const auto x : row)
+                                     {
+                                       if (x % 2 == 0)
+                                       {
+                                         s += x;
+                                       }
+                                     }
+                                   }
+                                   do_not_optimize(s);
+                                 }));
+                  report("filter_flatten", "std::ranges", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   u64 s = 0;
+                                   for (auto x : rows | std::views::join |
+                                                     std::views::filter([](u32 x) { return x % 2 == 0; }))
+                                   {
+                                     s += x;
+                                   }
+                                   do_not_optimize(s);
+                                 }));
+                } });
+
+  b.push_back({ "split", [](const Config& c, usize n)
+                {
+                  // Count the fields of n bytes of tab separated text, n counts bytes here.
+                  std::string text;
+                  const auto v = random_values(n / 4 + 1, 11);
+                  for (const auto x : v)
+                  {
+                    text += std::to_string(x % 1000);
+                    text += (x % 8 == 0) ? '\n' : '\t';
+                  }
+                  text.resize(n);
+                  const auto none = [] { return 0; };
+                  report("split", "Slice::split", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   usize fields = 0;
+                                   rust::slice(text).lines().for_each([&fields](const auto& line)
+                                                                      { fields += line.split('\t').count(); });
+                                   do_not_optimize(fields);
+                                 }));
+                  report("split", "string_view::find", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   usize fields = 0;
+                                   std::string_view rest = text;
+                                   while (!rest.empty())
+                                   {
+                                     const auto eol = rest.find('\n');
+                                     std::string_view line = rest.substr(0, eol);
+                                     rest = eol == std::string_view::npos ? std::string_view() : rest.substr(eol + 1);
+                                     for (usize pos = 0;; fields++)
+                                     {
+                                       const auto tab = line.find('\t', pos);
+                                       if (tab == std::string_view::npos)
+                                       {
+                                         fields++;
+                                         break;
+                                       }
+                                       pos = tab + 1;
+                                     }
+                                   }
+                                   do_not_optimize(fields);
+                                 }));
+                } });
+
+  b.push_back({ "binary_search", [](const Config& c, usize n)
+                {
+                  // 4096 lookups of random values in a sorted table of n values.
+                  auto table = random_values(n, 12);
+                  std::sort(table.begin(), table.end());
+                  const auto needles = random_values(4096, 13);
+                  const auto none = [] { return 0; };
+                  report("binary_search", "binary_search", n,
+                         measure(c, needles.size(), none,
+                                 [&](int)
+                                 {
+                                   usize hits = 0;
+                                   for (const auto x : needles)
+                                   {
+                                     hits += rust::slice(table).binary_search(x).is_ok();
+                                   }
+                                   do_not_optimize(hits);
+                                 }));
+                  report("binary_search", "binary_search_many", n,
+                         measure(c, needles.size(), none,
+                                 [&](int)
+                                 {
+                                   auto r = rust::slice(table).binary_search_many(needles);
+                                   do_not_optimize(r.data());
+                                 }));
+                  report("binary_search", "std::lower_bound", n,
+                         measure(c, needles.size(), none,
+                                 [&](int)
+                                 {
+                                   usize hits = 0;
+                                   for (const auto x : needles)
+                                   {
+                                     auto it = std::lower_bound(table.begin(), table.end(), x);
+                                     hits += it != table.end() && *it == x;
+                                   }
+                                   do_not_optimize(hits);
+                                 }));
+                } });
+
+  b.push_back({ "step_by", [](const Config& c, usize n)
+                {
+                  // Sample every 64th value, the rust::iter variant skips with advance_by.
+                  const auto v = random_values(n, 9);
+                  const usize step = 64;
+                  const auto none = [] { return 0; };
+                  report("step_by", "rust::iter", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   u64 s = rust::iter(v).step_by(step).copied().sum();
+                                   do_not_optimize(s);
+                                 }));
+                  report("step_by", "raw loop", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   u64 s = 0;
+                                   for (usize i = 0; i < v.size(); i += step)
+                                   {
+                                     s += v[i];
+                                   }
+                                   do_not_optimize(s);
+                                 }));
+                } });
+
+  b.push_back({ "serialize", [](const Config& c, usize n)
+                {
+                  // Encode a Vec of n values and decode it again, compared to the text from to_string.
+                  const rust::Vec<u32> v(random_values(n, 17));
+                  const auto bytes = rust::to_bytes(v);
+                  const auto none = [] { return 0; };
+                  report("serialize", "to_bytes", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   auto r = rust::to_bytes(v);
+                                   do_not_optimize(r.as_ptr());
+                                 }));
+                  report("serialize", "from_bytes Slice", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   auto r = rust::from_bytes<rust::Slice<const u32>>(bytes);
+                                   do_not_optimize(r.as_ptr());
+                                 }));
+                  report("serialize", "from_bytes Vec", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   auto r = rust::from_bytes<rust::Vec<u32>>(bytes);
+                                   do_not_optimize(r.as_ptr());
+                                 }));
+                  report("serialize", "to_string", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   auto r = to_string(v);
+                                   do_not_optimize(r.data());
+                                 }));
+                } });
+
+#if defined(__unix__) || defined(__APPLE__)
+  b.push_back({ "open_file", [](const Config& c, usize n)
+                {
+                  // Open a sorted table of n values from a file and do 64 lookups, like a service starting up.
+                  auto table = random_values(n, 14);
+                  std::sort(table.begin(), table.end());
+                  const auto path = (std::filesystem::temp_directory_path() / "bench_iterators_table.bin").string();
+                  {
+                    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+                    out.write(reinterpret_cast<const char*>(table.data()),
+                              static_cast<std::streamsize>(table.size() * sizeof(u32)));
+                  }
+                  const auto needles = random_values(64, 15);
+                  const auto none = [] { return 0; };
+                  report("open_file", "Mmap", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   auto map = rust::Mmap::open(path).unwrap();
+                                   map.advise(rust::Advice::Random);
+                                   const auto s = map.as_slice<u32>();
+                                   usize hits = 0;
+                                   for (const auto x : needles)
+                                   {
+                                     hits += s.binary_search(x).is_ok();
+                                   }
+                                   do_not_optimize(hits);
+                                 }));
+                  report("open_file", "read into vector", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   std::ifstream in(path, std::ios::binary);
+                                   std::vector<u32> v(n);
+                                   in.read(reinterpret_cast<char*>(v.data()), static_cast<std::streamsize>(n * sizeof(u32)));
+                                   usize hits = 0;
+                                   for (const auto x : needles)
+                                   {
+                                     hits += rust::slice(v).binary_search(x).is_ok();
+                                   }
+                                   do_not_optimize(hits);
+                                 }));
+                  std::filesystem::remove(path);
+                } });
+
+  b.push_back({ "read_lines", [](const Config& c, usize n)
+                {
+                  // Sum the lengths of n lines of text read from a file, numbers of a few digits each.
+                  const auto v = random_values(n, 16);
+                  const auto path = (std::filesystem::temp_directory_path() / "bench_iterators_lines.txt").string();
+                  {
+                    std::ofstream out(path, std::ios::trunc);
+                    for (const auto x : v)
+                    {
+                      out << x % 1000000 << "\n";
+                    }
+                  }
+                  const auto none = [] { return 0; };
+                  report("read_lines", "io::BufReader", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   auto reader = rust::io::BufReader::open(path).unwrap();
+                                   usize total = reader.lines().map([](const auto& l) { return l.len(); }).sum();
+                                   do_not_optimize(total);
+                                 }));
+                  report("read_lines", "std::getline", n,
+                         measure(c, n, none,
+                                 [&](int)
+                                 {
+                                   std::ifstream in(path);
+                                   std::string line;
+                                   usize total = 0;
+                                   while (std::getline(in, line))
+                                   {
+                                     total += line.size();
+                                   }
+                                   do_not_optimize(total);
+                                 }));
+                  std::filesystem::remove(path);
+                } });
+#endif
+
+  return b;
+}
+
+constexpr const char* usage = "usage: bench_iterators [--min N] [--max N] [--min-time SECONDS] [--filter SUBSTRING]";
+
+// A number such as 1000 or 1e6, None if anything other than a number is given.
+rust::Option<double> parse_number(const char* s)
+{
+  char* end = nullptr;
+  const double v = std::strtod(s, &end);
+  if (end == s || *end != '\0' || !std::isfinite(v))
+  {
+    return rust::Option<double>();
+  }
+  return rust::Option<double>(v);
+}
+
+// A size of at least one, sizes go up by factors of ten from the minimum, so zero never ends.
+rust::Option<usize> parse_size(const char* s)
+{
+  return parse_number(s).and_then(
+      [](double v)
+      {
+        return v >= 1 && v <= static_cast<double>(std::numeric_limits<usize>::max() / 10) ? rust::Option<usize>(static_cast<usize>(v))
+                                                                                          : rust::Option<usize>();
+      });
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+  Config config;
+  for (int i = 1; i < argc; i++)
+  {
+    const std::string arg = argv[i];
+    if (i + 1 >= argc)
+    {
+      std::cerr << "missing value for " << arg << "\n" << usage << std::endl;
+      return 1;
+    }
+    const char* value = argv[++i];
+    bool valid = true;
+    if (arg == "--min")
+    {
+      valid = parse_size(value).Some(config.min_n);
+    }
+    else if (arg == "--max")
+    {
+      valid = parse_size(value).Some(config.max_n);
+    }
+    else if (arg == "--min-time")
+    {
+      valid = parse_number(value).Some(config.min_time) && config.min_time >= 0;
+    }
+    else if (arg == "--filter")
+    {
+      config.filter = value;
+    }
+    else
+    {
+      std::cerr << "unknown argument " << arg << "\n" << usage << std::endl;
+      return 1;
+    }
+    if (!valid)
+    {
+      std::cerr << "invalid value " << value << " for " << arg << "\n" << usage << std::endl;
+      return 1;
+    }
+  }
+
+  std::printf("%-12s %-14s %12s %12s %14s %8s\n", "benchmark", "variant", "n", "ns/elem", "bytes/run", "allocs");
+  for (const auto& benchmark : benchmarks())
+  {
+    if (!config.filter.empty() && benchmark.name.find(config.filter) == std::string::npos)
+    {
+      continue;
+    }
+    for (usize n = config.min_n; n <= config.max_n; n *= 10)
+    {
+      benchmark.run(config, n);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,255 @@
+/*
+Copyright 2023 Ivor Wanders
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the author nor the names of contributors may be used to
+  endorse or promote products derived from this software without specific
+  prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+// Buffered reading of file descriptors, for POSIX systems.
+// rust::io::BufReader reader(STDIN_FILENO);
+// reader.lines() -> Iterator<Slice<const char>>, views into the buffer of the reader.
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "rust_cpp_iterator.hpp"
+
+namespace rust
+{
+namespace io
+{
+
+class BufReader;
+
+namespace detail
+{
+/// Next function for BufReader::split() and lines(), yields the records without their delimiter.
+struct ReaderSplitNext
+{
+  Option<Slice<const char>> operator()();
+
+  BufReader* reader_;
+  char delim_;
+  bool strip_cr_;
+};
+}  // namespace detail
+
+/// Reads a file descriptor through one reusable buffer, such as stdin or a pipe, and hands out
+/// records as slices into that buffer. Records are found with memchr; bytes are only moved when
+/// a record straddles the end of the buffer, and the buffer only grows for records longer than
+/// it. A slice is valid until the next record is read, copy what must be kept.
+class BufReader
+{
+public:
+  /// Read from fd, which remains owned by the caller.
+  explicit BufReader(int fd, usize capacity = 64 * 1024) : fd_(fd), buf_(capacity == 0 ? 1 : capacity)
+  {
+  }
+
+  /// Open path for reading, the reader closes it.
+  static Result<BufReader, std::error_code> open(const std::string& path, usize capacity = 64 * 1024)
+  {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+      return Result<BufReader, std::error_code>::Err(std::error_code(errno, std::system_category()));
+    }
+    BufReader reader(fd, capacity);
+    reader.owned_ = true;
+    return Result<BufReader, std::error_code>::Ok(std::move(reader));
+  }
+
+  BufReader(const BufReader&) = delete;
+  BufReader& operator=(const BufReader&) = delete;
+
+  BufReader(BufReader&& o) noexcept
+    : fd_(std::exchange(o.fd_, -1))
+    , owned_(std::exchange(o.owned_, false))
+    , buf_(std::move(o.buf_))
+    , start_(o.start_)
+    , end_(o.end_)
+    , eof_(o.eof_)
+    , error_(o.error_)
+  {
+  }
+
+  BufReader& operator=(BufReader&& o) noexcept
+  {
+    if (this != &o)
+    {
+      close();
+      fd_ = std::exchange(o.fd_, -1);
+      owned_ = std::exchange(o.owned_, false);
+      buf_ = std::move(o.buf_);
+      start_ = o.start_;
+      end_ = o.end_;
+      eof_ = o.eof_;
+      error_ = o.error_;
+    }
+    return *this;
+  }
+
+  ~BufReader()
+  {
+    close();
+  }
+
+  /// The next record up to and including delim, or up to the end of the input for the last one.
+  /// None once the input is exhausted or a read failed, see error().
+  Option<Slice<const char>> read_until(char delim)
+  {
+    usize scanned = start_;
+    while (true)
+    {
+      const void* found = std::memchr(buf_.data() + scanned, delim, end_ - scanned);
+      if (found != nullptr)
+      {
+        const usize end = static_cast<usize>(static_cast<const char*>(found) - buf_.data()) + 1;
+        return Option<Slice<const char>>(take(end));
+      }
+      if (eof_)
+      {
+        return start_ == end_ ? Option<Slice<const char>>() : Option<Slice<const char>>(take(end_));
+      }
+      scanned = end_ - start_;
+      fill();
+    }
+  }
+
+  /// The records separated by delim, without the delimiter.
+  auto split(char delim)
+  {
+    return rust::detail::make_iterator<Slice<const char>>(detail::ReaderSplitNext{ this, delim, false }, 0);
+  }
+
+  /// The lines, without the "\n" or "\r\n" that ends them.
+  auto lines()
+  {
+    return rust::detail::make_iterator<Slice<const char>>(detail::ReaderSplitNext{ this, '\n', true }, 0);
+  }
+
+  /// The error of the read that ended the input early, if any.
+  std::error_code error() const
+  {
+    return error_;
+  }
+
+  /// The size of the buffer, which only grows for records that do not fit in it.
+  usize capacity() const
+  {
+    return buf_.size();
+  }
+
+private:
+  Slice<const char> take(usize end)
+  {
+    const auto record = Slice<const char>::from_raw_parts(buf_.data() + start_, end - start_);
+    start_ = end;
+    return record;
+  }
+
+  // Move the partial record to the front and read behind it, growing the buffer if the partial
+  // record fills all of it.
+  void fill()
+  {
+    if (start_ != 0)
+    {
+      std::memmove(buf_.data(), buf_.data() + start_, end_ - start_);
+      end_ -= start_;
+      start_ = 0;
+    }
+    if (end_ == buf_.size())
+    {
+      buf_.resize(2 * buf_.size());
+    }
+    while (true)
+    {
+      const ssize_t n = ::read(fd_, buf_.data() + end_, buf_.size() - end_);
+      if (n > 0)
+      {
+        end_ += static_cast<usize>(n);
+        return;
+      }
+      if (n < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (n < 0)
+      {
+        error_ = std::error_code(errno, std::system_category());
+      }
+      eof_ = true;
+      return;
+    }
+  }
+
+  void close()
+  {
+    if (owned_ && fd_ >= 0)
+    {
+      ::close(fd_);
+    }
+    fd_ = -1;
+  }
+
+  int fd_;
+  bool owned_{ false };
+  std::vector<char> buf_;
+  usize start_{ 0 };
+  usize end_{ 0 };
+  bool eof_{ false };
+  std::error_code error_{};
+};
+
+inline Option<Slice<const char>> detail::ReaderSplitNext::operator()()
+{
+  auto record = reader_->read_until(delim_);
+  if (record.is_none())
+  {
+    return record;
+  }
+  Slice<const char> s = std::move(record).unwrap();
+  usize n = s.len();
+  if (n > 0 && s.as_ptr()[n - 1] == delim_)
+  {
+    n--;
+    if (strip_cr_ && n > 0 && s.as_ptr()[n - 1] == '\r')
+    {
+      n--;
+    }
+  }
+  return Option<Slice<const char>>(Slice<const char>::from_raw_parts(s.as_ptr(), n));
+}
+
+}  // namespace io
+}  // namespace rust
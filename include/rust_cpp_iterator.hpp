@@ -28,12 +28,35 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #pragma once
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <compare>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <exception>
 #include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <span>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 // Container c{1,2,3};
 // iter(c) -> Iterator<Ref<T>>
 // iter_mut(c) -> Iterator<RefMut<T>>
@@ -149,6 +172,50 @@ SS& operator<<(SS& os, RefMut<T>& ref)
   return os;
 }
 
+/// Types with a spare value that can represent None specialise Niche, with a static none() that
+/// returns that value and a static is_none(const T&) to test for it. Option<T> is then stored as
+/// just a T, without a separate flag. Note that this means Some(none()) can't exist.
+template <typename T>
+struct Niche;
+
+template <typename T>
+concept HasNiche = requires(const T& v)
+{
+  {
+    Niche<T>::none()
+    } -> std::same_as<T>;
+  {
+    Niche<T>::is_none(v)
+    } -> std::convertible_to<bool>;
+};
+
+// References can't be null, so the null pointer is free to represent None.
+template <typename T>
+struct Niche<Ref<T>>
+{
+  static Ref<T> none()
+  {
+    return Ref<T>(nullptr);
+  }
+  static bool is_none(const Ref<T>& v)
+  {
+    return v == none();
+  }
+};
+
+template <typename T>
+struct Niche<RefMut<T>>
+{
+  static RefMut<T> none()
+  {
+    return RefMut<T>(nullptr);
+  }
+  static bool is_none(const RefMut<T>& v)
+  {
+    return v == none();
+  }
+};
+
 struct Unit
 {
 };
@@ -185,6 +252,44 @@ auto deref(T&& v) requires Dereferencable<T>
   return deref(*v);
 }
 
+template <typename A>
+concept HasNext = requires(A a)
+{
+  a.next();
+};
+
+/// An iterator that knows exactly how many values it will still yield.
+template <typename A>
+concept ExactSizeIterator = HasNext<A> && requires(const A& a)
+{
+  {
+    a.len()
+    } -> std::convertible_to<std::size_t>;
+};
+
+/// An iterator that can also yield values from the back.
+template <typename A>
+concept DoubleEndedIterator = HasNext<A> && requires(A a)
+{
+  a.next_back().is_some();
+};
+
+/// The number of elements to reserve when collecting an iterator; exact if the length is known,
+/// otherwise the lower bound from size_hint. The upper bound is not used, a filter over a large
+/// input would reserve for every element while often yielding few of them.
+template <typename It>
+std::size_t reserve_hint(const It& it)
+{
+  if constexpr (ExactSizeIterator<It>)
+  {
+    return it.len();
+  }
+  else
+  {
+    return it.size_hint().template get<0>();
+  }
+}
+
 template <typename A>
 struct FromIterator;
 
@@ -197,11 +302,7 @@ struct FromIterator<A>
   template <typename It>
   static A from_iter(It&& it)
   {
-    auto z = it.next();
-    while (z.is_some())
-    {
-      z = it.next();
-    }
+    std::move(it).for_each([](auto&&) {});
     if constexpr (!std::is_same_v<A, void>)
     {
       return A{};
@@ -209,34 +310,97 @@ struct FromIterator<A>
   }
 };
 
-template <typename A>
-struct FromIterator<std::vector<A>>
+/// Append the values of an iterator to the end of c, reserving from the size hint once. Values of
+/// an iterator over contiguous memory of the element type are appended with one bulk copy, which
+/// is a memmove for trivially copyable elements.
+template <typename C, typename It>
+void extend_back(C& c, It&& it)
 {
-  template <typename It>
-  static std::vector<A> from_iter(It&& it)
+  using A = typename C::value_type;
+  if constexpr (requires { it.as_slice(); })
   {
-    std::vector<A> c;
-    auto [lower, upper] = it.size_hint();
-    if (std::size_t limit; upper.Some(limit))
-    {
-      c.reserve(limit);
-    }
-    else
+    using Element = std::remove_cv_t<typename decltype(it.as_slice())::type>;
+    if constexpr (std::is_same_v<Element, A> && std::is_trivially_copyable_v<A>)
     {
-      c.reserve(lower);
+      const auto s = it.as_slice();
+      c.insert(c.end(), s.as_ptr(), s.as_ptr() + s.len());
+      it.advance_by(s.len());
+      return;
     }
-    while (true)
-    {
-      auto z = it.next();
-      if (z.is_some())
-      {
-        c.push_back(deref(std::move(z).unwrap()));
-      }
-      else
+  }
+  // Growing to at least twice the capacity keeps many small appends amortized O(1).
+  const usize needed = c.size() + reserve_hint(it);
+  if (needed > c.capacity())
+  {
+    c.reserve(std::max(needed, 2 * c.capacity()));
+  }
+  std::move(it).for_each(
+      [&c](auto&& v)
       {
-        break;
-      }
-    }
+        if constexpr (std::constructible_from<A, decltype(v)>)
+        {
+          c.push_back(std::move(v));
+        }
+        else
+        {
+          c.push_back(deref(std::move(v)));
+        }
+      });
+}
+
+/// Element I of a Tuple, std::tuple or std::pair, such that maps collect from any of them.
+template <usize I, typename P>
+decltype(auto) tuple_part(P& p)
+{
+  if constexpr (requires { p.template get<I>(); })
+  {
+    return (p.template get<I>());
+  }
+  else
+  {
+    return (std::get<I>(p));
+  }
+}
+
+template <typename A, typename Alloc>
+struct FromIterator<std::vector<A, Alloc>>
+{
+  template <typename It>
+  static std::vector<A, Alloc> from_iter(It&& it)
+  {
+    std::vector<A, Alloc> c;
+    extend_back(c, std::forward<It>(it));
+    return c;
+  }
+};
+
+/// Maps collect from (key, value) tuples, a later value for the same key overwrites an earlier one.
+template <typename K, typename V, typename Hash, typename Eq, typename Alloc>
+struct FromIterator<std::unordered_map<K, V, Hash, Eq, Alloc>>
+{
+  template <typename It>
+  static std::unordered_map<K, V, Hash, Eq, Alloc> from_iter(It&& it)
+  {
+    std::unordered_map<K, V, Hash, Eq, Alloc> c;
+    c.reserve(reserve_hint(it));
+    std::move(it).for_each(
+        [&c](auto&& kv)
+        { c.insert_or_assign(deref(std::move(tuple_part<0>(kv))), deref(std::move(tuple_part<1>(kv)))); });
+    return c;
+  }
+};
+
+template <typename K, typename V, typename Compare, typename Alloc>
+struct FromIterator<std::map<K, V, Compare, Alloc>>
+{
+  template <typename It>
+  static std::map<K, V, Compare, Alloc> from_iter(It&& it)
+  {
+    std::map<K, V, Compare, Alloc> c;
+    // Hinting the end makes collecting keys that arrive in order linear.
+    std::move(it).for_each(
+        [&c](auto&& kv)
+        { c.insert_or_assign(c.end(), deref(std::move(tuple_part<0>(kv))), deref(std::move(tuple_part<1>(kv)))); });
     return c;
   }
 };
@@ -248,39 +412,56 @@ struct FromIterator<std::string>
   static std::string from_iter(It&& it)
   {
     std::string s;
-    auto [lower, upper] = it.size_hint();
-    if (std::size_t limit; upper.Some(limit))
-    {
-      s.reserve(limit);
-    }
-    else
-    {
-      s.reserve(lower);
-    }
-    while (true)
-    {
-      auto z = it.next();
-      if (z.is_some())
-      {
-        auto c = deref(std::move(z).unwrap());
-        static_assert(std::is_same_v<decltype(c), char>, "may only collect string from char");
-        s.push_back(c);
-      }
-      else
-      {
-        break;
-      }
-    }
+    s.reserve(reserve_hint(it));
+    std::move(it).for_each(
+        [&s](auto&& v)
+        {
+          auto c = deref(std::move(v));
+          static_assert(std::is_same_v<decltype(c), char>, "may only collect string from char");
+          s.push_back(c);
+        });
     return s;
   }
 };
 
+/// Append the values of an iterator to an existing container, see Iterator::collect_into.
+template <typename A>
+struct Extend;
+
+template <typename A, typename Alloc>
+struct Extend<std::vector<A, Alloc>>
+{
+  template <typename It>
+  static void extend(std::vector<A, Alloc>& c, It&& it)
+  {
+    extend_back(c, std::forward<It>(it));
+  }
+};
+
+template <>
+struct Extend<std::string>
+{
+  template <typename It>
+  static void extend(std::string& s, It&& it)
+  {
+    static_assert(std::is_same_v<decltype(deref(std::declval<typename std::remove_cvref_t<It>::type>())), char>,
+                  "may only extend string with char");
+    extend_back(s, std::forward<It>(it));
+  }
+};
+
 template <typename A, typename B>
 concept Add = requires(A a, B b)
 {
   a + b;
 };
 
+template <typename A, typename B>
+concept Mul = requires(A a, B b)
+{
+  a * b;
+};
+
 template <typename A>
 concept DataSize = requires(A a)
 {
@@ -297,12 +478,6 @@ concept Borrowable = requires(A a)
   Borrow<A>::borrow(a);
 };
 
-template <typename A>
-concept HasNext = requires(A a)
-{
-  a.next();
-};
-
 template <class A>
 struct IntoIterator;
 
@@ -462,8 +637,164 @@ SS& operator<<(SS& os, const Tuple<T...>& t)
 template <typename T>
 using TypeOrUnit = typename std::conditional_t<std::is_same_v<T, void>, Unit, T>;
 
+/// Storage for Option, a flag next to a union that holds the value while populated. Every special
+/// member is trivial when the matching one of T is, otherwise it costs exactly one T operation.
+template <typename T, bool = HasNiche<T>>
+struct OptionStorage
+{
+  OptionStorage()
+  {
+  }
+
+  OptionStorage(const OptionStorage&) requires std::is_trivially_copy_constructible_v<T>
+  = default;
+  OptionStorage(const OptionStorage& o)
+  {
+    if (o.populated_)
+    {
+      emplace(o.v_);
+    }
+  }
+
+  OptionStorage(OptionStorage&&) requires std::is_trivially_move_constructible_v<T>
+  = default;
+  OptionStorage(OptionStorage&& o) noexcept(std::is_nothrow_move_constructible_v<T>)
+  {
+    if (o.populated_)
+    {
+      emplace(std::move(o.v_));
+    }
+  }
+
+  OptionStorage& operator=(const OptionStorage&) requires(std::is_trivially_copy_assignable_v<T>&& std::
+                                                               is_trivially_copy_constructible_v<T>&& std::
+                                                                   is_trivially_destructible_v<T>) = default;
+  OptionStorage& operator=(const OptionStorage& o)
+  {
+    assign(o);
+    return *this;
+  }
+
+  OptionStorage& operator=(OptionStorage&&) requires(std::is_trivially_move_assignable_v<T>&& std::
+                                                         is_trivially_move_constructible_v<T>&& std::
+                                                             is_trivially_destructible_v<T>) = default;
+  OptionStorage& operator=(OptionStorage&& o) noexcept(std::is_nothrow_move_assignable_v<T>&&
+                                                           std::is_nothrow_move_constructible_v<T>)
+  {
+    assign(std::move(o));
+    return *this;
+  }
+
+  ~OptionStorage() requires std::is_trivially_destructible_v<T>
+  = default;
+  ~OptionStorage()
+  {
+    reset();
+  }
+
+  bool has_value() const
+  {
+    return populated_;
+  }
+
+  T& value()
+  {
+    return v_;
+  }
+  const T& value() const
+  {
+    return v_;
+  }
+
+  template <typename... Args>
+  void emplace(Args&&... args)
+  {
+    reset();
+    std::construct_at(&v_, std::forward<Args>(args)...);
+    populated_ = true;
+  }
+
+  void reset()
+  {
+    if (populated_)
+    {
+      std::destroy_at(&v_);
+      populated_ = false;
+    }
+  }
+
+private:
+  // Assign into an existing value, construct into an empty one, or drop ours. Types that can't be
+  // assigned, like lambdas with captures, are destroyed and constructed again.
+  template <typename Other>
+  void assign(Other&& o)
+  {
+    if (o.populated_ && populated_)
+    {
+      if constexpr (std::is_assignable_v<T&, decltype((std::forward<Other>(o).v_))>)
+      {
+        v_ = std::forward<Other>(o).v_;
+      }
+      else
+      {
+        emplace(std::forward<Other>(o).v_);
+      }
+    }
+    else if (o.populated_)
+    {
+      emplace(std::forward<Other>(o).v_);
+    }
+    else
+    {
+      reset();
+    }
+  }
+
+  bool populated_{ false };
+
+  // Hairy storage for the optional without allocation.
+  union
+  {
+    char not_used_{ 0 };
+    T v_;
+  };
+};
+
+/// Storage for types with a Niche, None is stored as the niche value, no flag is needed.
+template <typename T>
+struct OptionStorage<T, true>
+{
+  bool has_value() const
+  {
+    return !Niche<T>::is_none(v_);
+  }
+
+  T& value()
+  {
+    return v_;
+  }
+  const T& value() const
+  {
+    return v_;
+  }
+
+  template <typename... Args>
+  void emplace(Args&&... args)
+  {
+    v_ = T(std::forward<Args>(args)...);
+  }
+
+  void reset()
+  {
+    v_ = Niche<T>::none();
+  }
+
+private:
+  T v_{ Niche<T>::none() };
+};
+
 template <typename T>
-struct Option
+struct Option : private OptionStorage<T>
 {
   using type = T;
   using NoneType = Option<T>;
@@ -472,16 +803,16 @@ struct Option
   Option<TypeOrUnit<typename std::invoke_result_t<F, T>>> map(F&& f)
   {
     using U = TypeOrUnit<typename std::invoke_result_t<F, T>>;
-    if (populated_)
+    if (is_some())
     {
       if constexpr (std::is_same_v<U, Unit>)
       {
-        f(v_);
+        f(this->value());
         return Option<U>(Unit{});
       }
       else
       {
-        return Option<U>(f(v_));
+        return Option<U>(f(this->value()));
       }
     }
     else
@@ -507,17 +838,18 @@ struct Option
 
   T unwrap() &&
   {
-    if (populated_)
+    if (is_none())
     {
-      populated_ = false;
-      return std::move(v_);
+      throw panic_error("unwrap called on empty Option");
     }
-    throw panic_error("unwrap called on empty Option");
+    T v = std::move(this->value());
+    this->reset();
+    return v;
   }
 
   bool is_some() const
   {
-    return populated_;
+    return this->has_value();
   }
   bool is_none() const
   {
@@ -526,9 +858,9 @@ struct Option
 
   bool Some(T& x) &
   {
-    if (populated_)
+    if (is_some())
     {
-      x = v_;
+      x = this->value();
       return true;
     }
     return false;
@@ -536,10 +868,10 @@ struct Option
 
   bool Some(T& x) &&
   {
-    if (populated_)
+    if (is_some())
     {
-      populated_ = false;
-      x = std::move(v_);
+      x = std::move(this->value());
+      this->reset();
       return true;
     }
     return false;
@@ -547,25 +879,25 @@ struct Option
 
   auto operator<=>(const Option<T>& other) const
   {
-    if (populated_ && other.populated_)
+    if (is_some() && other.is_some())
     {
-      return v_ <=> other.v_;
+      return this->value() <=> other.value();
     }
     else
     {
-      return populated_ <=> other.populated_;
+      return is_some() <=> other.is_some();
     }
   };
 
   auto operator==(const Option<T>& other) const
   {
-    if (populated_ && other.populated_)
+    if (is_some() && other.is_some())
     {
-      return v_ == other.v_;
+      return this->value() == other.value();
     }
     else
     {
-      return populated_ == other.populated_;
+      return is_some() == other.is_some();
     }
   };
 
@@ -573,7 +905,7 @@ struct Option
   {
     if (is_some())
     {
-      return Option<Ref<T>>(&v_);
+      return Option<Ref<T>>(&this->value());
     }
     else
     {
@@ -585,7 +917,7 @@ struct Option
   {
     if (is_some())
     {
-      return Option<RefMut<T>>(&v_);
+      return Option<RefMut<T>>(&this->value());
     }
     else
     {
@@ -593,55 +925,36 @@ struct Option
     }
   }
 
+  // Construct the value in place, excluding Option itself so this never hijacks a copy.
   template <typename... Args>
-  Option(Args... v) : v_(v...), populated_{ true }
+  requires(sizeof...(Args) > 0 && std::constructible_from<T, Args&&...> &&
+           !(sizeof...(Args) == 1 && (std::is_same_v<std::remove_cvref_t<Args>, Option<T>> && ...)))
+  Option(Args&&... v)
   {
-    std::construct_at(&v_, std::forward<Args>(v)...);
+    this->emplace(std::forward<Args>(v)...);
   };
-  Option(const T& v) : populated_{ true }
+  Option(const T& v)
   {
-    std::construct_at(&v_, v);
+    this->emplace(v);
   };
-  Option(T&& v) : v_(v), populated_{ true }
+  Option(T&& v)
   {
-    std::construct_at(&v_, std::move(v));
+    this->emplace(std::move(v));
   };
-  Option() : populated_{ false } {};
+  Option() = default;
 
-  // Is this a copy constructor, or constructing an Option holding an Option!?
-  Option(const Option<T>& v) : populated_{ v.populated_ }
-  {
-    // call the constructor for v_.
-    if (v.is_some())
-    {
-      std::construct_at(&v_, v.as_ref().unwrap().deref());
-    }
-  };
-  ~Option()
-  {
-    if (populated_)
-    {
-      std::destroy_at(&v_);
-    }
-  }
-
-  Option<T>& operator=(Option<T>&& v)
-  {
-    populated_ = v.populated_;
-    std::construct_at(&v_, std::move(v.v_));
-    v.populated_ = false;
-    return *this;
-  }
+  // Copies and moves come from the storage, they're trivial when T's are. Like std::optional, a
+  // moved from Option stays populated with a moved from value.
+  Option(const Option<T>&) = default;
+  Option(Option<T>&&) = default;
+  Option<T>& operator=(const Option<T>&) = default;
+  Option<T>& operator=(Option<T>&&) = default;
 
 private:
-  bool populated_{ false };
-
-  // Hairy storage for the optional without allocation.
-  union
-  {
-    char not_used_{ 0 };
-    T v_;
-  };
+  template <typename U, bool>
+  friend struct OptionStorage;
+  template <typename U>
+  friend struct Option;
 };
 
 template <typename T>
@@ -665,6 +978,95 @@ SS& operator<<(SS& os, const Option<T>& opt)
   return os;
 }
 
+/// Either a value (Ok) or an error (Err), only what binary_search needs for now; construct with
+/// Result<T, E>::Ok(v) or Result<T, E>::Err(e).
+template <typename T, typename E>
+struct Result
+{
+  static Result<T, E> Ok(T v)
+  {
+    Result<T, E> r;
+    r.ok_ = Option<T>(std::move(v));
+    return r;
+  }
+
+  static Result<T, E> Err(E e)
+  {
+    Result<T, E> r;
+    r.err_ = Option<E>(std::move(e));
+    return r;
+  }
+
+  bool is_ok() const
+  {
+    return ok_.is_some();
+  }
+  bool is_err() const
+  {
+    return err_.is_some();
+  }
+
+  T unwrap() &&
+  {
+    if (is_err())
+    {
+      throw panic_error("unwrap called on an Err Result");
+    }
+    return std::move(ok_).unwrap();
+  }
+
+  E unwrap_err() &&
+  {
+    if (is_ok())
+    {
+      throw panic_error("unwrap_err called on an Ok Result");
+    }
+    return std::move(err_).unwrap();
+  }
+
+  Option<T> ok() &&
+  {
+    return std::move(ok_);
+  }
+
+  Option<E> err() &&
+  {
+    return std::move(err_);
+  }
+
+  bool operator==(const Result<T, E>& other) const
+  {
+    return ok_ == other.ok_ && err_ == other.err_;
+  }
+
+private:
+  Result() = default;
+
+  Option<T> ok_;
+  Option<E> err_;
+
+  template <typename A, typename B>
+  friend std::string to_string(const Result<A, B>& r);
+};
+
+template <typename T, typename E>
+std::string to_string(const Result<T, E>& r)
+{
+  if (r.is_ok())
+  {
+    return std::string("Ok(") + to_string(r.ok_.as_ref().unwrap().deref()) + ")";
+  }
+  return std::string("Err(") + to_string(r.err_.as_ref().unwrap().deref()) + ")";
+}
+
+/// Make a Result printable.
+template <typename SS, typename T, typename E>
+SS& operator<<(SS& os, const Result<T, E>& r)
+{
+  os << to_string(r);
+  return os;
+}
+
 /// Helper struct to allow return type conversion.
 template <typename It>
 struct Collector
@@ -717,666 +1119,5512 @@ struct RangeIter
   IterPtr it_;  //  iff nullptr, end iterator.
 };
 
-template <typename T, typename NextFun>
-struct Iterator
+/// Invoke f, turning a void return into Unit.
+template <typename F, typename... Args>
+auto invoke_or_unit(F& f, Args&&... args)
 {
-  using type = T;
-  using function_type = NextFun;
+  if constexpr (std::is_void_v<std::invoke_result_t<F&, Args...>>)
+  {
+    f(std::forward<Args>(args)...);
+    return Unit{};
+  }
+  else
+  {
+    return f(std::forward<Args>(args)...);
+  }
+}
 
-  struct ReturnTypeCollect
+// Internal iteration; a next function may provide fold and try_fold members that consume it in a
+// tight loop, the fallbacks below pull one Option at a time.
+template <typename NextFun, typename Acc, typename G>
+Acc fold_next(NextFun& fun, Acc acc, G& g)
+{
+  if constexpr (requires { fun.fold(std::move(acc), g); })
   {
-  };
+    return fun.fold(std::move(acc), g);
+  }
+  else
+  {
+    auto v = fun();
+    while (v.is_some())
+    {
+      acc = g(std::move(acc), std::move(v).unwrap());
+      v = fun();
+    }
+    return acc;
+  }
+}
+
+template <typename NextFun, typename Acc, typename G>
+Option<Acc> try_fold_next(NextFun& fun, Acc acc, G& g)
+{
+  if constexpr (requires { fun.try_fold(std::move(acc), g); })
+  {
+    return fun.try_fold(std::move(acc), g);
+  }
+  else
+  {
+    auto v = fun();
+    while (v.is_some())
+    {
+      auto r = g(std::move(acc), std::move(v).unwrap());
+      if (r.is_none())
+      {
+        return r;
+      }
+      acc = std::move(r).unwrap();
+      v = fun();
+    }
+    return Option<Acc>(std::move(acc));
+  }
+}
 
-  Iterator(NextFun&& f, std::size_t size) : f_(f), size_(size){};
+using SizeHint = Tuple<usize, Option<usize>>;
 
-  Option<T> next()
+template <typename T>
+struct Slice;
+
+template <typename T, typename Alloc>
+struct Vec;
+
+/// Next functions that know their remaining length provide len(), this makes the Iterator an ExactSizeIterator.
+template <typename NextFun>
+concept ExactSizeNext = requires(const NextFun& f)
+{
   {
-    return f_();
-  };
+    f.len()
+    } -> std::convertible_to<usize>;
+};
 
-  Tuple<usize, Option<usize>> size_hint() const
+/// Next functions may provide size_hint(), otherwise the Iterator reports what it was constructed with.
+template <typename NextFun>
+concept SizeHintNext = requires(const NextFun& f)
+{
   {
-    return Tuple<usize, Option<usize>>(size_, Option<usize>());
-  }
+    f.size_hint()
+    } -> std::convertible_to<SizeHint>;
+};
 
-  // [[nodiscard("map is not consumed")]]  doesn't work? :<
-  template <std::invocable<T> F>
-  auto map(F&& f)
+inline SizeHint exact_size_hint(usize n)
+{
+  return SizeHint(n, Option<usize>(n));
+}
+
+/// Combine two upper bounds, taking the smallest known one.
+inline Option<usize> min_upper(Option<usize> a, Option<usize> b)
+{
+  usize x = 0;
+  usize y = 0;
+  const bool has_x = a.Some(x);
+  const bool has_y = b.Some(y);
+  if (has_x && has_y)
   {
-    using U = TypeOrUnit<typename std::invoke_result_t<F, T>>;
-    auto generator = [this, f]() mutable -> Option<U> { return this->next().map(f); };
-    return make_iterator<U>(std::move(generator), size_);
+    return Option<usize>(std::min(x, y));
   }
-
-  template <Iterable It>
-  auto zip(It&& f) &&
+  if (has_x)
   {
-    auto our_it = std::move(f_);
-    auto other_it = into_iter(f);
-    bool finished = false;
+    return Option<usize>(x);
+  }
+  if (has_y)
+  {
+    return Option<usize>(y);
+  }
+  return Option<usize>();
+}
 
-    const auto [our_lowest, our_highest] = size_hint();
-    const auto [other_lowest, other_highest] = other_it.size_hint();
-    const auto new_lowest = std::min<usize>(our_lowest, other_lowest);
+/// Next function walking a pair of raw iterators, yielding a Ref or RefMut for each element.
+template <typename RawIter, typename Wrapper>
+struct RangeNext
+{
+  usize len() const requires std::sized_sentinel_for<RawIter, RawIter>
+  {
+    return static_cast<usize>(end_ - start_);
+  }
 
-    // Get the types, both return an option, which we can get the type of.
-    using L = T;
-    using R = decltype(other_it)::type;
-    using U = Tuple<L, R>;
-    auto generator = [our_it, other_it, finished]() mutable -> Option<U>
-    {
-      if (finished)
-      {
-        return Option<U>();
-      }
-      auto l = our_it();
-      auto r = other_it.next();
-      if (l.is_none() || r.is_none())
-      {
-        finished = true;
-        return Option<U>();
-      }
-      auto l_r = U(std::move(l).unwrap(), std::move(r).unwrap());
-      return Option<U>(std::move(l_r));
-    };
+  SizeHint size_hint() const requires std::sized_sentinel_for<RawIter, RawIter>
+  {
+    return exact_size_hint(len());
+  }
 
-    return make_iterator<U>(std::move(generator), new_lowest);
+  /// Skip up to n elements, returns the number of steps that could not be taken.
+  usize advance_by(usize n) requires std::random_access_iterator<RawIter>
+  {
+    const usize step = std::min(n, len());
+    start_ += step;
+    return n - step;
   }
 
-  auto copied()
+  /// The remaining elements, for raw iterators over contiguous memory.
+  auto as_slice() const requires std::contiguous_iterator<RawIter>
   {
-    return map([](const auto& v) { return *v; });
-    //  using U = std::invoke_result<F, T>::type;
-    //  auto generator = [this, f]() mutable -> Option<U> { return this->next().map(f); };
-    //  return make_iterator<U>(std::move(generator), size_);
+    using Element = typename Wrapper::type;
+    return Slice<Element>::from_raw_parts(const_cast<Element*>(std::to_address(start_)), len());
   }
 
-  template <std::predicate<T> F>
-  bool any(F&& f) &&
+  Option<Wrapper> operator()()
   {
-    using U = std::invoke_result<F, T>::type;
-    static_assert(std::is_same<U, bool>::value, "return for any must be bool");
-    auto value = next();
-    while (value.is_some())
+    if (start_ != end_)
     {
-      if (f(std::move(value).unwrap()))
-      {
-        return true;
-      }
-      value = next();
+      auto v = Wrapper(std::addressof(*start_));
+      start_++;
+      return Option<Wrapper>(std::move(v));
     }
-    return false;
+    return Option<Wrapper>();
   }
 
-  auto enumerate() &&
+  Option<Wrapper> next_back() requires std::bidirectional_iterator<RawIter>
   {
-    std::size_t i = 0;
-    auto f = std::move(f_);
-    using U = std::tuple<usize, T>;
-    auto generator = [this, f, i]() mutable -> Option<U>
+    if (start_ != end_)
     {
-      auto v = f();
-      if (v.is_some())
-      {
-        auto res = Option<U>(i, std::move(v).unwrap());
-        i++;
-        return res;
-      }
-      else
-      {
-        return Option<U>();
-      }
-    };
-    return make_iterator<U>(std::move(generator), size_);
+      --end_;
+      return Option<Wrapper>(Wrapper(std::addressof(*end_)));
+    }
+    return Option<Wrapper>();
   }
 
-  template <typename CollectType = ReturnTypeCollect>
-  auto collect() &&
+  template <typename Acc, typename G>
+  Acc fold(Acc acc, G& g)
   {
-    if constexpr (std::is_same<CollectType, ReturnTypeCollect>::value)
-    {
-      return Collector{ std::move(*this) };
-    }
-    else
+    for (; start_ != end_; ++start_)
     {
-      return FromIterator<CollectType>::from_iter(std::move(*this));
+      acc = g(std::move(acc), Wrapper(std::addressof(*start_)));
     }
+    return acc;
   }
 
-  auto sum() && requires Add<T, T>
+  template <typename Acc, typename G>
+  Option<Acc> try_fold(Acc acc, G& g)
   {
-    auto first = f_();
-    if (first.is_some())
+    while (start_ != end_)
     {
-      auto current = std::move(first).unwrap();
-      auto i_next = next();
-      while (i_next.is_some())
+      auto r = g(std::move(acc), Wrapper(std::addressof(*start_)));
+      ++start_;
+      if (r.is_none())
       {
-        std::cout << "Next: " << i_next << std::endl;
-        current = current + std::move(i_next).unwrap();  // should call the sum trait really.
-        i_next = next();
+        return r;
       }
-      return current;
-    }
-    else
-    {
-      return typename decltype(first)::type{};  // should be the zero value of a type... but alas.
+      acc = std::move(r).unwrap();
     }
+    return Option<Acc>(std::move(acc));
   }
 
-  auto begin()
-  {
-    return RangeIter<T, decltype(this)>::begin(this);
-  }
-  auto end()
-  {
-    return RangeIter<T, decltype(this)>::end();
-  }
+  RawIter start_;
+  RawIter end_;
+};
 
-private:
-  template <typename Z, typename U>
-  friend struct RangeIter;
-  template <typename Z>
-  friend struct FromIterator;
+/// Next functions over contiguous memory expose the remaining elements as a slice.
+template <typename NextFun>
+concept ContiguousNext = requires(NextFun f, usize n)
+{
+  f.as_slice();
+  f.advance_by(n);
+};
 
-  NextFun f_;
-  usize size_;
+/// Next functions that can skip values without producing them provide advance_by(n), returning the
+/// number of steps that could not be taken.
+template <typename NextFun>
+concept AdvanceNext = requires(NextFun f, usize n)
+{
+  {
+    f.advance_by(n)
+    } -> std::convertible_to<usize>;
 };
 
-template <typename Z, typename RealNextFun>
-static auto make_iterator(RealNextFun&& v, std::size_t size)
+/// Next functions that can also take values from the back provide next_back().
+template <typename NextFun>
+concept DoubleEndedNext = requires(NextFun f)
 {
-  return Iterator<Z, RealNextFun>{ std::forward<RealNextFun>(v), size };
+  f.next_back().is_some();
 };
 
-template <typename Z, typename RawIter>
-static auto make_iterator(RawIter&& start_, RawIter&& end_, usize size)
+/// Next function for map(), applies f to every value of the upstream iterator.
+template <typename Upstream, typename F>
+struct MapNext
 {
-  auto start = start_;
-  auto end = end_;
-  using Wrapper = RefWrapper<decltype(*start)>;
-  return detail::make_iterator<Wrapper>(
-      [start, end]() mutable
-      {
-        if (start != end)
-        {
-          auto v = Wrapper(std::addressof(*start));
-          start++;
-          return detail::Option(v);
-        }
-        else
-        {
-          return detail::Option<Wrapper>();
-        }
-      },
-      size);
-}
+  auto operator()()
+  {
+    return map_value(it_.next());
+  }
 
-template <typename Child, typename Z>
-struct SliceInterface;
+  auto next_back() requires DoubleEndedIterator<Upstream>
+  {
+    return map_value(it_.next_back());
+  }
 
-template <typename T>
-struct Slice : SliceInterface<Slice<T>, T>
-{
-  using type = T;
+  // Values are moved into f, such that owned values like drained strings are never copied.
+  template <typename Acc, typename G>
+  Acc fold(Acc acc, G& g)
+  {
+    return std::move(it_).fold(std::move(acc), [this, &g](Acc a, auto&& v)
+                               { return g(std::move(a), invoke_or_unit(f_, std::forward<decltype(v)>(v))); });
+  }
 
-  static Slice<T> from_raw_parts(T* data, usize len)
+  template <typename Acc, typename G>
+  Option<Acc> try_fold(Acc acc, G& g)
   {
-    Slice<T> res;
-    res.begin_ = data;
-    res.len_ = len;
-    return res;
+    return it_.try_fold(std::move(acc), [this, &g](Acc a, auto&& v)
+                        { return g(std::move(a), invoke_or_unit(f_, std::forward<decltype(v)>(v))); });
   }
 
-  T* _begin() const
+  template <typename V>
+  auto map_value(Option<V> v)
   {
-    return begin_;
+    using U = decltype(invoke_or_unit(f_, std::declval<V>()));
+    if (v.is_none())
+    {
+      return Option<U>();
+    }
+    return Option<U>(invoke_or_unit(f_, std::move(v).unwrap()));
   }
-  usize _len() const
+
+  SizeHint size_hint() const
   {
-    return len_;
+    return it_.size_hint();
   }
 
-private:
-  T* begin_;
-  std::size_t len_;
+  usize len() const requires ExactSizeIterator<Upstream>
+  {
+    return it_.len();
+  }
+
+  Upstream it_;
+  F f_;
 };
 
-template <typename Child, typename T>
-struct SliceInterface
+/// Next function for by_ref(), borrows the upstream iterator such that it can be used again after
+/// the adapters on top of it are done.
+template <typename Upstream>
+struct ByRefNext
 {
-  SliceInterface() : child_(*static_cast<Child*>(this))
+  auto operator()()
   {
+    return it_->next();
   }
 
-  usize len() const
+  auto next_back() requires DoubleEndedIterator<Upstream>
   {
-    return child_._len();
+    return it_->next_back();
   }
 
-  T& operator[](usize index)
+  // Folding through a reference must leave the upstream usable, so it is a try_fold that never breaks.
+  template <typename Acc, typename G>
+  Acc fold(Acc acc, G& g)
   {
-    if (index >= len())
-    {
-      throw panic_error("out of bounds access");
-    }
-    return begin()[index];
+    return it_->try_fold(std::move(acc), [&g](Acc a, auto&& v) { return Option<Acc>(g(std::move(a), std::move(v))); })
+        .unwrap();
   }
 
-  const T& operator[](usize index) const
+  template <typename Acc, typename G>
+  Option<Acc> try_fold(Acc acc, G& g)
   {
-    if (index >= len())
-    {
-      throw panic_error("out of bounds access");
-    }
-    return begin()[index];
+    return it_->try_fold(std::move(acc), g);
   }
 
-  const T& get_unchecked(usize index) const
+  SizeHint size_hint() const
   {
-    return (*this)[index];
+    return it_->size_hint();
   }
 
-  T& get_unchecked_mut(usize index)
+  usize len() const requires ExactSizeIterator<Upstream>
   {
-    return (*this)[index];
+    return it_->len();
   }
 
-  Option<Ref<T>> last() const
+  Upstream* it_;
+};
+
+/// Next function for rev(), swaps the ends of a double ended upstream iterator.
+template <typename Upstream>
+struct RevNext
+{
+  auto operator()()
   {
-    if (len() > 0)
-    {
-      return Option<Ref<T>>(Ref<T>(&get_unchecked(len() - 1)));
-    }
-    return Option<Ref<T>>();
+    return it_.next_back();
   }
 
-  Option<Ref<T>> first() const
+  auto next_back()
   {
-    if (len() > 0)
-    {
-      return Option<Ref<T>>(Ref<T>(&get_unchecked(0)));
-    }
-    return Option<Ref<T>>();
+    return it_.next();
   }
 
-  Option<RefMut<T>> first_mut()
+  SizeHint size_hint() const
   {
-    if (len() > 0)
-    {
-      return Option<RefMut<T>>(RefMut<T>(&get_unchecked_mut(0)));
+    return it_.size_hint();
+  }
+
+  usize len() const requires ExactSizeIterator<Upstream>
+  {
+    return it_.len();
+  }
+
+  Upstream it_;
+};
+
+/// Next function for enumerate(), pairs the upstream values with their index.
+template <typename Upstream>
+struct EnumerateNext
+{
+  using U = std::tuple<usize, typename Upstream::type>;
+
+  Option<U> operator()()
+  {
+    auto v = it_.next();
+    if (v.is_some())
+    {
+      auto res = Option<U>(i_, std::move(v).unwrap());
+      i_++;
+      return res;
     }
-    return Option<RefMut<T>>();
+    return Option<U>();
   }
 
-  /// Take a subslice
-  template <typename A = std::initializer_list<int>, typename B = std::initializer_list<int>>
-  Slice<T> operator()(A a, B b) const
+  usize advance_by(usize n)
   {
-    using std::to_string;
-    usize start = 0;
-    usize end = len();
-    if constexpr (!std::is_same<A, std::initializer_list<int>>::value)
+    const usize missing = it_.advance_by(n);
+    i_ += n - missing;
+    return missing;
+  }
+
+  // The index of the last value follows from the number of values before it.
+  Option<U> next_back() requires DoubleEndedIterator<Upstream> && ExactSizeIterator<Upstream>
+  {
+    auto v = it_.next_back();
+    if (v.is_some())
     {
-      start = a;
+      return Option<U>(i_ + it_.len(), std::move(v).unwrap());
     }
-    if constexpr (!std::is_same<B, std::initializer_list<int>>::value)
+    return Option<U>();
+  }
+
+  template <typename Acc, typename G>
+  Acc fold(Acc acc, G& g)
+  {
+    return std::move(it_).fold(std::move(acc),
+                               [this, &g](Acc a, auto&& v) { return g(std::move(a), U(i_++, std::move(v))); });
+  }
+
+  template <typename Acc, typename G>
+  Option<Acc> try_fold(Acc acc, G& g)
+  {
+    return it_.try_fold(std::move(acc), [this, &g](Acc a, auto&& v) { return g(std::move(a), U(i_++, std::move(v))); });
+  }
+
+  SizeHint size_hint() const
+  {
+    return it_.size_hint();
+  }
+
+  usize len() const requires ExactSizeIterator<Upstream>
+  {
+    return it_.len();
+  }
+
+  Upstream it_;
+  usize i_{ 0 };
+};
+
+/// Next function for skip(), drops the first n values of the upstream on first use.
+template <typename Upstream>
+struct SkipNext
+{
+  auto operator()()
+  {
+    skip();
+    return it_.next();
+  }
+
+  auto next_back() requires DoubleEndedIterator<Upstream> && ExactSizeIterator<Upstream>
+  {
+    return len() > 0 ? it_.next_back() : Option<typename Upstream::type>();
+  }
+
+  usize advance_by(usize n)
+  {
+    skip();
+    return it_.advance_by(n);
+  }
+
+  template <typename Acc, typename G>
+  Acc fold(Acc acc, G& g)
+  {
+    skip();
+    return std::move(it_).fold(std::move(acc), g);
+  }
+
+  template <typename Acc, typename G>
+  Option<Acc> try_fold(Acc acc, G& g)
+  {
+    skip();
+    return it_.try_fold(std::move(acc), g);
+  }
+
+  SizeHint size_hint() const
+  {
+    auto [lower, upper] = it_.size_hint();
+    return SizeHint(lower - std::min(lower, n_), upper.map([this](usize u) { return u - std::min(u, n_); }));
+  }
+
+  usize len() const requires ExactSizeIterator<Upstream>
+  {
+    const usize l = it_.len();
+    return l - std::min(l, n_);
+  }
+
+  void skip()
+  {
+    if (n_ != 0)
     {
-      end = b;
+      it_.advance_by(n_);
+      n_ = 0;
     }
-    if (start > end)
+  }
+
+  Upstream it_;
+  usize n_;
+};
+
+/// Next function for take(), yields at most n values of the upstream.
+template <typename Upstream>
+struct TakeNext
+{
+  auto operator()()
+  {
+    if (n_ == 0)
     {
-      throw panic_error("slice index  starts at " + to_string(start) + " but ends at " + to_string(end));
+      return Option<typename Upstream::type>();
     }
-    if (end > len())
+    n_--;
+    return it_.next();
+  }
+
+  usize advance_by(usize n)
+  {
+    const usize step = std::min(n, n_);
+    const usize taken = step - it_.advance_by(step);
+    n_ -= taken;
+    return n - taken;
+  }
+
+  template <typename Acc, typename G>
+  Acc fold(Acc acc, G& g)
+  {
+    auto always = [&g](Acc a, auto&& v) { return Option<Acc>(g(std::move(a), std::move(v))); };
+    return try_fold(std::move(acc), always).unwrap();
+  }
+
+  template <typename Acc, typename G>
+  Option<Acc> try_fold(Acc acc, G& g)
+  {
+    if (n_ == 0)
     {
-      throw panic_error("range end index " + to_string(end) + " out of range for slice of length " + to_string(len()));
+      return Option<Acc>(std::move(acc));
     }
+    // Break out of the upstream once n values are taken, keeping the accumulator aside.
+    Option<Acc> done;
+    auto r = it_.try_fold(std::move(acc),
+                          [this, &g, &done](Acc a, auto&& v) -> Option<Acc>
+                          {
+                            auto next = g(std::move(a), std::move(v));
+                            n_--;
+                            if (next.is_some() && n_ == 0)
+                            {
+                              done = std::move(next);
+                              return Option<Acc>();
+                            }
+                            return next;
+                          });
+    return done.is_some() ? done : r;
+  }
 
-    return Slice<T>::from_raw_parts(begin() + start, end - start);
+  SizeHint size_hint() const
+  {
+    const auto [lower, upper] = it_.size_hint();
+    return SizeHint(std::min(lower, n_), min_upper(upper, Option<usize>(n_)));
   }
 
-  auto iter() const
+  usize len() const requires ExactSizeIterator<Upstream>
   {
-    auto start = begin();
-    auto end = begin() + len();
+    return std::min(it_.len(), n_);
+  }
 
-    using Wrapper = RefWrapper<const T>;
-    return detail::make_iterator<Wrapper>(
-        [start, end]() mutable
+  Upstream it_;
+  usize n_;
+};
+
+/// Next function for step_by(), yields the first value and then every step-th value after it.
+template <typename Upstream>
+struct StepByNext
+{
+  auto operator()()
+  {
+    if (first_)
+    {
+      first_ = false;
+      return it_.next();
+    }
+    return it_.nth(step_ - 1);
+  }
+
+  SizeHint size_hint() const
+  {
+    auto [lower, upper] = it_.size_hint();
+    return SizeHint(steps(lower), upper.map([this](usize u) { return steps(u); }));
+  }
+
+  usize len() const requires ExactSizeIterator<Upstream>
+  {
+    return steps(it_.len());
+  }
+
+  // The number of values yielded from n remaining upstream values.
+  usize steps(usize n) const
+  {
+    if (first_)
+    {
+      return n == 0 ? 0 : 1 + (n - 1) / step_;
+    }
+    return n / step_;
+  }
+
+  Upstream it_;
+  usize step_;
+  bool first_{ true };
+};
+
+/// Next function for filter(), yields the upstream values for which the predicate holds.
+template <typename Upstream, typename P>
+struct FilterNext
+{
+  using U = typename Upstream::type;
+
+  Option<U> operator()()
+  {
+    for (auto v = it_.next(); v.is_some(); v = it_.next())
+    {
+      if (p_(std::as_const(v.as_ref().unwrap().deref())))
+      {
+        return v;
+      }
+    }
+    return Option<U>();
+  }
+
+  Option<U> next_back() requires DoubleEndedIterator<Upstream>
+  {
+    for (auto v = it_.next_back(); v.is_some(); v = it_.next_back())
+    {
+      if (p_(std::as_const(v.as_ref().unwrap().deref())))
+      {
+        return v;
+      }
+    }
+    return Option<U>();
+  }
+
+  template <typename Acc, typename G>
+  Acc fold(Acc acc, G& g)
+  {
+    return std::move(it_).fold(std::move(acc),
+                               [this, &g](Acc a, auto&& v) -> Acc
+                               {
+                                 // Not a conditional expression, that would copy a for every rejected value.
+                                 if (p_(std::as_const(v)))
+                                 {
+                                   return g(std::move(a), std::move(v));
+                                 }
+                                 return a;
+                               });
+  }
+
+  template <typename Acc, typename G>
+  Option<Acc> try_fold(Acc acc, G& g)
+  {
+    return it_.try_fold(std::move(acc),
+                        [this, &g](Acc a, auto&& v)
+                        { return p_(std::as_const(v)) ? g(std::move(a), std::move(v)) : Option<Acc>(std::move(a)); });
+  }
+
+  SizeHint size_hint() const
+  {
+    return SizeHint(0, it_.size_hint().template get<1>());
+  }
+
+  Upstream it_;
+  P p_;
+};
+
+/// Next function for filter_map(), f returns an Option and the values in the Somes are yielded.
+template <typename Upstream, typename F>
+struct FilterMapNext
+{
+  using U = typename std::invoke_result_t<F&, typename Upstream::type>::type;
+
+  Option<U> operator()()
+  {
+    for (auto v = it_.next(); v.is_some(); v = it_.next())
+    {
+      auto r = f_(std::move(v).unwrap());
+      if (r.is_some())
+      {
+        return r;
+      }
+    }
+    return Option<U>();
+  }
+
+  Option<U> next_back() requires DoubleEndedIterator<Upstream>
+  {
+    for (auto v = it_.next_back(); v.is_some(); v = it_.next_back())
+    {
+      auto r = f_(std::move(v).unwrap());
+      if (r.is_some())
+      {
+        return r;
+      }
+    }
+    return Option<U>();
+  }
+
+  template <typename Acc, typename G>
+  Acc fold(Acc acc, G& g)
+  {
+    return std::move(it_).fold(std::move(acc),
+                               [this, &g](Acc a, auto&& v) -> Acc
+                               {
+                                 auto r = f_(std::move(v));
+                                 if (r.is_some())
+                                 {
+                                   return g(std::move(a), std::move(r).unwrap());
+                                 }
+                                 return a;
+                               });
+  }
+
+  template <typename Acc, typename G>
+  Option<Acc> try_fold(Acc acc, G& g)
+  {
+    return it_.try_fold(std::move(acc),
+                        [this, &g](Acc a, auto&& v)
+                        {
+                          auto r = f_(std::move(v));
+                          return r.is_some() ? g(std::move(a), std::move(r).unwrap()) : Option<Acc>(std::move(a));
+                        });
+  }
+
+  SizeHint size_hint() const
+  {
+    return SizeHint(0, it_.size_hint().template get<1>());
+  }
+
+  Upstream it_;
+  F f_;
+};
+
+/// Next function for take_while(), yields values until the predicate fails for the first time.
+template <typename Upstream, typename P>
+struct TakeWhileNext
+{
+  using U = typename Upstream::type;
+
+  Option<U> operator()()
+  {
+    if (done_)
+    {
+      return Option<U>();
+    }
+    auto v = it_.next();
+    if (v.is_some() && p_(std::as_const(v.as_ref().unwrap().deref())))
+    {
+      return v;
+    }
+    done_ = true;
+    return Option<U>();
+  }
+
+  template <typename Acc, typename G>
+  Acc fold(Acc acc, G& g)
+  {
+    auto always = [&g](Acc a, auto&& v) { return Option<Acc>(g(std::move(a), std::move(v))); };
+    return try_fold(std::move(acc), always).unwrap();
+  }
+
+  template <typename Acc, typename G>
+  Option<Acc> try_fold(Acc acc, G& g)
+  {
+    if (done_)
+    {
+      return Option<Acc>(std::move(acc));
+    }
+    // Break out of the upstream at the first failing value, keeping the accumulator aside.
+    Option<Acc> stopped;
+    auto r = it_.try_fold(std::move(acc),
+                          [this, &g, &stopped](Acc a, auto&& v) -> Option<Acc>
+                          {
+                            if (!p_(std::as_const(v)))
+                            {
+                              done_ = true;
+                              stopped = Option<Acc>(std::move(a));
+                              return Option<Acc>();
+                            }
+                            return g(std::move(a), std::move(v));
+                          });
+    return stopped.is_some() ? stopped : r;
+  }
+
+  SizeHint size_hint() const
+  {
+    return done_ ? exact_size_hint(0) : SizeHint(0, it_.size_hint().template get<1>());
+  }
+
+  Upstream it_;
+  P p_;
+  bool done_{ false };
+};
+
+/// Next function for skip_while(), drops values until the predicate fails, then yields the rest.
+template <typename Upstream, typename P>
+struct SkipWhileNext
+{
+  using U = typename Upstream::type;
+
+  Option<U> operator()()
+  {
+    if (skipping_)
+    {
+      skipping_ = false;
+      for (auto v = it_.next(); v.is_some(); v = it_.next())
+      {
+        if (!p_(std::as_const(v.as_ref().unwrap().deref())))
         {
-          if (start != end)
-          {
-            auto v = Wrapper(start);
-            start++;
-            return detail::Option(std::move(v));
-          }
-          else
-          {
-            return detail::Option<Wrapper>();
-          }
-        },
-        len());
+          return v;
+        }
+      }
+      return Option<U>();
+    }
+    return it_.next();
   }
 
-  auto iter_mut() const
+  template <typename Acc, typename G>
+  Acc fold(Acc acc, G& g)
+  {
+    if (skipping_)
+    {
+      auto first = (*this)();
+      if (first.is_none())
+      {
+        return acc;
+      }
+      acc = g(std::move(acc), std::move(first).unwrap());
+    }
+    return std::move(it_).fold(std::move(acc), g);
+  }
+
+  template <typename Acc, typename G>
+  Option<Acc> try_fold(Acc acc, G& g)
+  {
+    if (skipping_)
+    {
+      auto first = (*this)();
+      if (first.is_none())
+      {
+        return Option<Acc>(std::move(acc));
+      }
+      auto r = g(std::move(acc), std::move(first).unwrap());
+      if (r.is_none())
+      {
+        return r;
+      }
+      acc = std::move(r).unwrap();
+    }
+    return it_.try_fold(std::move(acc), g);
+  }
+
+  SizeHint size_hint() const
+  {
+    return skipping_ ? SizeHint(0, it_.size_hint().template get<1>()) : it_.size_hint();
+  }
+
+  Upstream it_;
+  P p_;
+  bool skipping_{ true };
+};
+
+/// Next function for map_while(), f returns an Option, values are yielded until the first None.
+template <typename Upstream, typename F>
+struct MapWhileNext
+{
+  using U = typename std::invoke_result_t<F&, typename Upstream::type>::type;
+
+  Option<U> operator()()
+  {
+    if (done_)
+    {
+      return Option<U>();
+    }
+    auto v = it_.next();
+    if (v.is_none())
+    {
+      done_ = true;
+      return Option<U>();
+    }
+    auto r = f_(std::move(v).unwrap());
+    done_ = r.is_none();
+    return r;
+  }
+
+  SizeHint size_hint() const
+  {
+    return done_ ? exact_size_hint(0) : SizeHint(0, it_.size_hint().template get<1>());
+  }
+
+  Upstream it_;
+  F f_;
+  bool done_{ false };
+};
+
+/// Next function for scan(), f gets a mutable state and each value, stops at the first None it returns.
+template <typename Upstream, typename St, typename F>
+struct ScanNext
+{
+  using U = typename std::invoke_result_t<F&, St&, typename Upstream::type>::type;
+
+  Option<U> operator()()
+  {
+    if (done_)
+    {
+      return Option<U>();
+    }
+    auto v = it_.next();
+    if (v.is_none())
+    {
+      done_ = true;
+      return Option<U>();
+    }
+    auto r = f_(state_, std::move(v).unwrap());
+    done_ = r.is_none();
+    return r;
+  }
+
+  SizeHint size_hint() const
+  {
+    return done_ ? exact_size_hint(0) : SizeHint(0, it_.size_hint().template get<1>());
+  }
+
+  Upstream it_;
+  St state_;
+  F f_;
+  bool done_{ false };
+};
+
+/// Next function for fuse(), once the upstream returned None it is never called again.
+template <typename Upstream>
+struct FuseNext
+{
+  using U = typename Upstream::type;
+
+  Option<U> operator()()
+  {
+    if (done_)
+    {
+      return Option<U>();
+    }
+    auto v = it_.next();
+    done_ = v.is_none();
+    return v;
+  }
+
+  Option<U> next_back() requires DoubleEndedIterator<Upstream>
+  {
+    if (done_)
+    {
+      return Option<U>();
+    }
+    auto v = it_.next_back();
+    done_ = v.is_none();
+    return v;
+  }
+
+  template <typename Acc, typename G>
+  Acc fold(Acc acc, G& g)
+  {
+    if (done_)
+    {
+      return acc;
+    }
+    done_ = true;
+    return std::move(it_).fold(std::move(acc), g);
+  }
+
+  template <typename Acc, typename G>
+  Option<Acc> try_fold(Acc acc, G& g)
+  {
+    if (done_)
+    {
+      return Option<Acc>(std::move(acc));
+    }
+    auto r = it_.try_fold(std::move(acc), g);
+    done_ = r.is_some();
+    return r;
+  }
+
+  SizeHint size_hint() const
+  {
+    return done_ ? exact_size_hint(0) : it_.size_hint();
+  }
+
+  usize len() const requires ExactSizeIterator<Upstream>
+  {
+    return done_ ? 0 : it_.len();
+  }
+
+  Upstream it_;
+  bool done_{ false };
+};
+
+template <typename C>
+struct DrainNext;
+
+template <typename V>
+struct IsSlice : std::false_type
+{
+};
+
+template <typename T>
+struct IsSlice<Slice<T>> : std::true_type
+{
+};
+
+/// The iterator flatten() walks for each value of the outer iterator. Iterators are used as they
+/// are, slices and references to containers are iterated in place, owned containers with an
+/// into_iter() are consumed by it and other owned containers are drained.
+template <typename V>
+auto flatten_inner(V&& v)
+{
+  using Value = std::remove_cvref_t<V>;
+  if constexpr (HasNext<Value>)
+  {
+    return Value(std::move(v));
+  }
+  else if constexpr (IsSlice<Value>::value)
+  {
+    return v.iter();
+  }
+  else if constexpr (requires { std::move(v).into_iter(); })
+  {
+    return std::move(v).into_iter();
+  }
+  else if constexpr (Dereferencable<Value>)
+  {
+    auto& inner = *v;
+    if constexpr (!std::is_const_v<std::remove_reference_t<decltype(inner)>> && requires { inner.iter_mut(); })
+    {
+      return inner.iter_mut();
+    }
+    else if constexpr (requires { inner.iter(); })
+    {
+      return inner.iter();
+    }
+    else
+    {
+      return into_iter(inner);
+    }
+  }
+  else
+  {
+    const usize size = v.size();
+    return make_iterator<typename Value::value_type>(DrainNext<Value>{ std::move(v), size }, size);
+  }
+}
+
+/// Next function for flatten(), yields the values of each iterable the upstream yields. fold runs
+/// a fold on each inner iterator, for slices of slices and vectors of vectors that is a plain loop
+/// per inner slice.
+template <typename Upstream>
+struct FlattenNext
+{
+  using Inner = decltype(flatten_inner(std::declval<typename Upstream::type>()));
+  using U = typename Inner::type;
+
+  Option<U> operator()()
+  {
+    while (true)
+    {
+      if (front_.is_some())
+      {
+        auto v = front_.as_mut().unwrap().deref().next();
+        if (v.is_some())
+        {
+          return v;
+        }
+        front_ = Option<Inner>();
+      }
+      auto outer = it_.next();
+      if (outer.is_none())
+      {
+        return Option<U>();
+      }
+      front_ = Option<Inner>(flatten_inner(std::move(outer).unwrap()));
+    }
+  }
+
+  template <typename Acc, typename G>
+  Acc fold(Acc acc, G& g)
+  {
+    if (front_.is_some())
+    {
+      acc = std::move(front_.as_mut().unwrap().deref()).fold(std::move(acc), g);
+      front_ = Option<Inner>();
+    }
+    return std::move(it_).fold(std::move(acc),
+                               [&g](Acc a, auto&& v) { return flatten_inner(std::move(v)).fold(std::move(a), g); });
+  }
+
+  template <typename Acc, typename G>
+  Option<Acc> try_fold(Acc acc, G& g)
+  {
+    if (front_.is_some())
+    {
+      auto r = front_.as_mut().unwrap().deref().try_fold(std::move(acc), g);
+      if (r.is_none())
+      {
+        return r;
+      }
+      acc = std::move(r).unwrap();
+    }
+    // The inner iterator is kept in front_, such that a short circuit can be resumed.
+    return it_.try_fold(std::move(acc),
+                        [this, &g](Acc a, auto&& v)
+                        {
+                          front_ = Option<Inner>(flatten_inner(std::move(v)));
+                          return front_.as_mut().unwrap().deref().try_fold(std::move(a), g);
+                        });
+  }
+
+  // Only the inner iterator in progress is known, the rest is only bounded once the upstream is empty.
+  SizeHint size_hint() const
+  {
+    auto [lower, upper] = front_.is_some() ? front_.as_ref().unwrap().deref().size_hint() : exact_size_hint(0);
+    usize outer_upper = 0;
+    if (it_.size_hint().template get<1>().Some(outer_upper) && outer_upper == 0)
+    {
+      return SizeHint(lower, upper);
+    }
+    return SizeHint(lower, Option<usize>());
+  }
+
+  Upstream it_;
+  Option<Inner> front_{};
+};
+
+/// Next function for zip(), yields tuples until either side runs out.
+template <typename Left, typename Right>
+struct ZipNext
+{
+  using U = Tuple<typename Left::type, typename Right::type>;
+
+  Option<U> operator()()
+  {
+    if (finished_)
+    {
+      return Option<U>();
+    }
+    auto l = left_.next();
+    if (l.is_none())
+    {
+      finished_ = true;
+      return Option<U>();
+    }
+    auto r = right_.next();
+    if (r.is_none())
+    {
+      finished_ = true;
+      return Option<U>();
+    }
+    return Option<U>(U(std::move(l).unwrap(), std::move(r).unwrap()));
+  }
+
+  SizeHint size_hint() const
+  {
+    if (finished_)
+    {
+      return exact_size_hint(0);
+    }
+    const auto [left_lower, left_upper] = left_.size_hint();
+    const auto [right_lower, right_upper] = right_.size_hint();
+    return SizeHint(std::min(left_lower, right_lower), min_upper(left_upper, right_upper));
+  }
+
+  usize len() const requires ExactSizeIterator<Left> && ExactSizeIterator<Right>
+  {
+    return finished_ ? 0 : std::min<usize>(left_.len(), right_.len());
+  }
+
+  Left left_;
+  Right right_;
+  bool finished_{ false };
+};
+
+template <typename T, typename NextFun>
+struct Iterator
+{
+  using type = T;
+  using function_type = NextFun;
+
+  struct ReturnTypeCollect
+  {
+  };
+
+  Iterator(NextFun&& f, std::size_t size) : f_(std::move(f)), size_(size){};
+
+  Option<T> next()
+  {
+    return f_();
+  };
+
+  /// Bounds on the remaining length, a known upper bound is exact for ExactSizeIterators.
+  Tuple<usize, Option<usize>> size_hint() const
+  {
+    if constexpr (SizeHintNext<NextFun>)
+    {
+      return f_.size_hint();
+    }
+    else
+    {
+      return Tuple<usize, Option<usize>>(size_, Option<usize>());
+    }
+  }
+
+  /// The exact remaining length, only available if the next function knows it.
+  usize len() const requires ExactSizeNext<NextFun>
+  {
+    return f_.len();
+  }
+
+  /// The elements left over by chunks_exact().
+  auto remainder() const requires requires(const NextFun& f) { f.remainder(); }
+  {
+    return f_.remainder();
+  }
+
+  /// Take a value from the back, only available if the next function can.
+  Option<T> next_back() requires DoubleEndedNext<NextFun>
+  {
+    return f_.next_back();
+  }
+
+  /// Iterate from the back to the front.
+  auto rev() && requires DoubleEndedNext<NextFun>
+  {
+    const usize size = size_;
+    return make_iterator<T>(RevNext<Iterator<T, NextFun>>{ std::move(*this) }, size);
+  }
+
+  /// The last value, taken from the back if possible instead of walking the whole iterator.
+  Option<T> last() &&
+  {
+    if constexpr (DoubleEndedNext<NextFun>)
+    {
+      return next_back();
+    }
+    else
+    {
+      return std::move(*this).fold(Option<T>(), [](Option<T>, auto&& v) { return Option<T>(std::move(v)); });
+    }
+  }
+
+  /// Search from the back for the first value for which f holds.
+  template <std::predicate<const T&> F>
+  Option<T> rfind(F&& f) requires DoubleEndedNext<NextFun>
+  {
+    for (auto v = next_back(); v.is_some(); v = next_back())
+    {
+      if (f(std::as_const(v.as_ref().unwrap().deref())))
+      {
+        return v;
+      }
+    }
+    return Option<T>();
+  }
+
+  /// The values that remain as a slice, for iterators over contiguous memory.
+  auto as_slice() const requires ContiguousNext<NextFun>
+  {
+    return f_.as_slice();
+  }
+
+  /// Skip up to n values, returns the number of steps that could not be taken. This is O(1) for
+  /// iterators over random access containers, otherwise values are produced and dropped.
+  usize advance_by(usize n)
+  {
+    if constexpr (AdvanceNext<NextFun>)
+    {
+      return f_.advance_by(n);
+    }
+    else
+    {
+      for (usize i = 0; i < n; i++)
+      {
+        if (next().is_none())
+        {
+          return n - i;
+        }
+      }
+      return 0;
+    }
+  }
+
+  /// The n-th value from here, the values before it are skipped.
+  Option<T> nth(usize n)
+  {
+    if (advance_by(n) != 0)
+    {
+      return Option<T>();
+    }
+    return next();
+  }
+
+  auto skip(usize n) &&
+  {
+    const usize size = size_ - std::min(size_, n);
+    return make_iterator<T>(SkipNext<Iterator<T, NextFun>>{ std::move(*this), n }, size);
+  }
+
+  auto take(usize n) &&
+  {
+    const usize size = std::min(size_, n);
+    return make_iterator<T>(TakeNext<Iterator<T, NextFun>>{ std::move(*this), n }, size);
+  }
+
+  /// Yield the first value and then every step-th value, skipping the ones in between with advance_by.
+  auto step_by(usize step) &&
+  {
+    if (step == 0)
+    {
+      throw panic_error("step must be non-zero");
+    }
+    const usize size = size_ == 0 ? 0 : 1 + (size_ - 1) / step;
+    return make_iterator<T>(StepByNext<Iterator<T, NextFun>>{ std::move(*this), step }, size);
+  }
+
+  /// Only yield the values for which f holds, f gets a const reference to each value.
+  template <std::predicate<const T&> F>
+  auto filter(F&& f) &&
+  {
+    return make_iterator<T>(FilterNext<Iterator<T, NextFun>, std::decay_t<F>>{ std::move(*this), std::forward<F>(f) }, 0);
+  }
+
+  /// Map with a function returning an Option, only the values of the Somes are yielded.
+  template <std::invocable<T> F>
+  auto filter_map(F&& f) &&
+  {
+    using Next = FilterMapNext<Iterator<T, NextFun>, std::decay_t<F>>;
+    return make_iterator<typename Next::U>(Next{ std::move(*this), std::forward<F>(f) }, 0);
+  }
+
+  template <std::predicate<const T&> F>
+  auto take_while(F&& f) &&
+  {
+    return make_iterator<T>(TakeWhileNext<Iterator<T, NextFun>, std::decay_t<F>>{ std::move(*this), std::forward<F>(f) },
+                            0);
+  }
+
+  template <std::predicate<const T&> F>
+  auto skip_while(F&& f) &&
+  {
+    return make_iterator<T>(SkipWhileNext<Iterator<T, NextFun>, std::decay_t<F>>{ std::move(*this), std::forward<F>(f) },
+                            0);
+  }
+
+  /// Map with a function returning an Option, stopping at the first None.
+  template <std::invocable<T> F>
+  auto map_while(F&& f) &&
+  {
+    using Next = MapWhileNext<Iterator<T, NextFun>, std::decay_t<F>>;
+    return make_iterator<typename Next::U>(Next{ std::move(*this), std::forward<F>(f) }, 0);
+  }
+
+  /// Like map_while, but f also gets a mutable reference to a state that starts at init.
+  template <typename St, std::invocable<St&, T> F>
+  auto scan(St init, F&& f) &&
+  {
+    using Next = ScanNext<Iterator<T, NextFun>, St, std::decay_t<F>>;
+    return make_iterator<typename Next::U>(Next{ std::move(*this), std::move(init), std::forward<F>(f) }, 0);
+  }
+
+  /// Yield the values of each iterable this iterator yields, see flatten_inner for what is accepted.
+  auto flatten() &&
+  {
+    using Next = FlattenNext<Iterator<T, NextFun>>;
+    return make_iterator<typename Next::U>(Next{ std::move(*this) }, 0);
+  }
+
+  template <std::invocable<T> F>
+  auto flat_map(F&& f) &&
+  {
+    return std::move(*this).map(std::forward<F>(f)).flatten();
+  }
+
+  /// After the first None, always return None.
+  auto fuse() &&
+  {
+    const usize size = size_;
+    return make_iterator<T>(FuseNext<Iterator<T, NextFun>>{ std::move(*this) }, size);
+  }
+
+  /// Index, counted from the front, of the last value for which f holds.
+  template <std::predicate<T> F>
+  Option<usize> rposition(F&& f) requires DoubleEndedNext<NextFun> && ExactSizeNext<NextFun>
+  {
+    for (usize i = len(); i > 0; i--)
+    {
+      if (f(std::move(next_back()).unwrap()))
+      {
+        return Option<usize>(i - 1);
+      }
+    }
+    return Option<usize>();
+  }
+
+  // [[nodiscard("map is not consumed")]]  doesn't work? :<
+  template <std::invocable<T> F>
+  auto map(F&& f) &&
+  {
+    using U = TypeOrUnit<typename std::invoke_result_t<F, T>>;
+    const usize size = size_;
+    return make_iterator<U>(MapNext<Iterator<T, NextFun>, std::decay_t<F>>{ std::move(*this), std::forward<F>(f) },
+                            size);
+  }
+
+  /// Borrow this iterator, adapters built on the result advance this one and leave it usable.
+  auto by_ref()
+  {
+    return make_iterator<T>(ByRefNext<Iterator<T, NextFun>>{ this }, size_);
+  }
+
+  template <Iterable It>
+  auto zip(It&& f) &&
+  {
+    using Other = decltype(into_iter(f));
+    using U = Tuple<T, typename Other::type>;
+    auto zipped = ZipNext<Iterator<T, NextFun>, Other>{ std::move(*this), into_iter(f) };
+    const usize lowest = zipped.size_hint().template get<0>();
+    return make_iterator<U>(std::move(zipped), lowest);
+  }
+
+  auto copied() &&
+  {
+    return std::move(*this).map([](const auto& v) { return *v; });
+  }
+
+  template <std::predicate<T> F>
+  bool any(F&& f) &&
+  {
+    using U = std::invoke_result<F, T>::type;
+    static_assert(std::is_same<U, bool>::value, "return for any must be bool");
+    // Breaking out of try_fold with a None means we found a value for which f holds.
+    return try_fold(Unit{}, [&f](Unit u, auto&& v) { return f(std::move(v)) ? Option<Unit>() : Option<Unit>(u); })
+        .is_none();
+  }
+
+  auto enumerate() &&
+  {
+    using U = std::tuple<usize, T>;
+    const usize size = size_;
+    return make_iterator<U>(EnumerateNext<Iterator<T, NextFun>>{ std::move(*this) }, size);
+  }
+
+  template <typename CollectType = ReturnTypeCollect>
+  auto collect() &&
+  {
+    if constexpr (std::is_same<CollectType, ReturnTypeCollect>::value)
+    {
+      return Collector{ std::move(*this) };
+    }
+    else
+    {
+      return FromIterator<CollectType>::from_iter(std::move(*this));
+    }
+  }
+
+  /// Append the values to an existing container through Extend, reserving once, and return it.
+  template <typename C>
+  C& collect_into(C& container) &&
+  {
+    Extend<C>::extend(container, std::move(*this));
+    return container;
+  }
+
+  /// Collect into a Vec that allocates from alloc, for example a std::pmr::polymorphic_allocator
+  /// over a std::pmr::monotonic_buffer_resource, such that everything is released in one go.
+  template <typename Alloc>
+  auto collect_in(const Alloc& alloc) && requires(!std::convertible_to<Alloc, std::pmr::memory_resource*>)
+  {
+    using Value = std::remove_cvref_t<decltype(deref(std::declval<T>()))>;
+    using Rebound = typename std::allocator_traits<Alloc>::template rebind_alloc<Value>;
+    Vec<Value, Rebound> v{ Rebound(alloc) };
+    v.extend(std::move(*this));
+    return v;
+  }
+
+  /// Collect into a Vec with a polymorphic allocator over the memory resource, like an arena.
+  auto collect_in(std::pmr::memory_resource* resource) &&
+  {
+    using Value = std::remove_cvref_t<decltype(deref(std::declval<T>()))>;
+    return std::move(*this).collect_in(std::pmr::polymorphic_allocator<Value>(resource));
+  }
+
+  /// Reduce all values into an accumulator, consuming the iterator. Next functions can provide
+  /// their own fold, such that this compiles into a plain loop instead of one next() per value.
+  template <typename Acc, std::invocable<Acc, T> F>
+  Acc fold(Acc init, F&& f) &&
+  {
+    return fold_next(f_, std::move(init), f);
+  }
+
+  /// Like fold, but f returns an Option<Acc>, iteration stops at the first None and that is
+  /// returned. The iterator is not consumed, it can be resumed after a short circuit.
+  template <typename Acc, std::invocable<Acc, T> F>
+  Option<Acc> try_fold(Acc init, F&& f)
+  {
+    return try_fold_next(f_, std::move(init), f);
+  }
+
+  /// Take the next N values as an array, if fewer than N values remain they are consumed and
+  /// None is returned.
+  template <usize N>
+  Option<std::array<T, N>> next_chunk()
+  {
+    if constexpr (ContiguousNext<NextFun>)
+    {
+      auto remaining = f_.as_slice();
+      f_.advance_by(N);
+      if (remaining.len() < N)
+      {
+        return Option<std::array<T, N>>();
+      }
+      return Option<std::array<T, N>>([&remaining]<usize... I>(std::index_sequence<I...>) {
+        return std::array<T, N>{ T(remaining.as_mut_ptr() + I)... };
+      }(std::make_index_sequence<N>{}));
+    }
+    else
+    {
+      std::array<Option<T>, N> values;
+      for (auto& v : values)
+      {
+        v = next();
+        if (v.is_none())
+        {
+          return Option<std::array<T, N>>();
+        }
+      }
+      return Option<std::array<T, N>>([&values]<usize... I>(std::index_sequence<I...>) {
+        return std::array<T, N>{ std::move(values[I]).unwrap()... };
+      }(std::make_index_sequence<N>{}));
+    }
+  }
+
+  /// Call f with batches of up to n values, consuming the iterator. If the iterator walks over
+  /// contiguous memory the batches are subslices of it, with the element type of the underlying
+  /// memory. Otherwise the values are gathered into a buffer and f gets a Slice<T> over that.
+  template <typename F>
+  void for_each_batch(usize n, F&& f) &&
+  {
+    if (n == 0)
+    {
+      throw panic_error("batch size must be non-zero");
+    }
+    if constexpr (ContiguousNext<NextFun>)
+    {
+      auto remaining = f_.as_slice();
+      f_.advance_by(remaining.len());
+      using Element = typename decltype(remaining)::type;
+      for (usize i = 0; i < remaining.len(); i += n)
+      {
+        f(Slice<Element>::from_raw_parts(remaining.as_mut_ptr() + i, std::min(n, remaining.len() - i)));
+      }
+    }
+    else
+    {
+      std::vector<T> buffer;
+      buffer.reserve(n);
+      std::move(*this).for_each(
+          [&](auto&& v)
+          {
+            buffer.push_back(std::move(v));
+            if (buffer.size() == n)
+            {
+              f(Slice<T>::from_raw_parts(buffer.data(), buffer.size()));
+              buffer.clear();
+            }
+          });
+      if (!buffer.empty())
+      {
+        f(Slice<T>::from_raw_parts(buffer.data(), buffer.size()));
+      }
+    }
+  }
+
+  template <std::invocable<T> F>
+  void for_each(F&& f) &&
+  {
+    std::move(*this).fold(Unit{},
+                          [&f](Unit u, auto&& v)
+                          {
+                            f(std::move(v));
+                            return u;
+                          });
+  }
+
+  usize count() &&
+  {
+    return std::move(*this).fold(usize{ 0 }, [](usize c, auto&&) { return c + 1; });
+  }
+
+  auto sum() && requires Add<T, T>
+  {
+    auto first = next();
+    if (first.is_none())
+    {
+      return T{};  // should be the zero value of a type... but alas.
+    }
+    // should call the sum trait really.
+    return std::move(*this).fold(std::move(first).unwrap(), [](T a, auto&& b) -> T { return a + std::move(b); });
+  }
+
+  auto product() && requires Mul<T, T>
+  {
+    auto first = next();
+    if (first.is_none())
+    {
+      return T{ 1 };
+    }
+    return std::move(*this).fold(std::move(first).unwrap(), [](T a, auto&& b) -> T { return a * std::move(b); });
+  }
+
+  auto begin()
+  {
+    return RangeIter<T, decltype(this)>::begin(this);
+  }
+  auto end()
+  {
+    return RangeIter<T, decltype(this)>::end();
+  }
+
+private:
+  template <typename Z, typename U>
+  friend struct RangeIter;
+  template <typename Z>
+  friend struct FromIterator;
+
+  NextFun f_;
+  usize size_;
+};
+
+template <typename Z, typename RealNextFun>
+static auto make_iterator(RealNextFun&& v, std::size_t size)
+{
+  return Iterator<Z, RealNextFun>{ std::forward<RealNextFun>(v), size };
+};
+
+template <typename Z, typename RawIter>
+static auto make_iterator(RawIter&& start_, RawIter&& end_, usize size)
+{
+  using Wrapper = RefWrapper<decltype(*start_)>;
+  using Raw = std::remove_cvref_t<RawIter>;
+  return detail::make_iterator<Wrapper>(RangeNext<Raw, Wrapper>{ start_, end_ }, size);
+}
+
+/// Types for which equality is equality of the object representation, such that runs of them can
+/// be compared with memcmp. Floating point is excluded (0.0 == -0.0, NaN != NaN).
+template <typename A, typename B>
+concept BitwiseComparable = std::is_same_v<std::remove_cv_t<A>, std::remove_cv_t<B>> &&
+                            (std::is_integral_v<A> || std::is_enum_v<A> || std::is_pointer_v<A>);
+
+/// Types whose lexicographical order is that of memcmp, which compares unsigned bytes.
+template <typename A, typename B>
+concept ByteOrdered = BitwiseComparable<A, B> && std::is_integral_v<A> && std::is_unsigned_v<A> && sizeof(A) == 1;
+
+template <typename A, typename B>
+bool slice_equal(const A* a, const B* b, usize n)
+{
+  if constexpr (BitwiseComparable<A, B>)
+  {
+    return n == 0 || std::memcmp(a, b, n * sizeof(A)) == 0;
+  }
+  else
+  {
+    for (usize i = 0; i < n; i++)
+    {
+      if (!(a[i] == b[i]))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+/// Index of the first element equal to x, or n if there is none.
+template <typename A>
+usize find_index(const A* p, usize n, const std::remove_cv_t<A>& x)
+{
+  if (n == 0)
+  {
+    return n;
+  }
+  if constexpr (BitwiseComparable<A, A> && sizeof(A) == 1)
+  {
+    const void* found = std::memchr(p, static_cast<unsigned char>(x), n);
+    return found == nullptr ? n : static_cast<usize>(static_cast<const A*>(found) - p);
+  }
+  else if constexpr (BitwiseComparable<A, A>)
+  {
+    // Check a block of elements without an early exit, such that the compiler can vectorise it.
+    constexpr usize block = std::max<usize>(64 / sizeof(A), 1);
+    usize i = 0;
+    for (; i + block <= n; i += block)
+    {
+      bool hit = false;
+      for (usize j = 0; j < block; j++)
+      {
+        hit |= p[i + j] == x;
+      }
+      if (hit)
+      {
+        break;
+      }
+    }
+    for (; i < n; i++)
+    {
+      if (p[i] == x)
+      {
+        return i;
+      }
+    }
+    return n;
+  }
+  else
+  {
+    for (usize i = 0; i < n; i++)
+    {
+      if (p[i] == x)
+      {
+        return i;
+      }
+    }
+    return n;
+  }
+}
+
+/// Thread pool with a deque of jobs per worker; workers pop their own jobs from the back and steal
+/// from the front of other deques when they run dry. Work is submitted through join().
+class ThreadPool
+{
+public:
+  explicit ThreadPool(usize threads)
+  {
+    threads = std::max<usize>(threads, 1);
+    for (usize i = 0; i < threads; i++)
+    {
+      queues_.push_back(std::make_unique<Queue>());
+    }
+    for (usize i = 0; i < threads; i++)
+    {
+      workers_.emplace_back([this, i]() { worker_loop(i); });
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex_);
+      stop_ = true;
+    }
+    sleep_cv_.notify_all();
+    for (auto& worker : workers_)
+    {
+      worker.join();
+    }
+  }
+
+  /// The pool used by par_iter(), with one worker per hardware thread unless the
+  /// RUST_CPP_NUM_THREADS environment variable says otherwise.
+  static ThreadPool& global()
+  {
+    static ThreadPool pool(
+        []() -> usize
+        {
+          if (const char* threads = std::getenv("RUST_CPP_NUM_THREADS"); threads != nullptr && std::atoi(threads) > 0)
+          {
+            return static_cast<usize>(std::atoi(threads));
+          }
+          return std::thread::hardware_concurrency();
+        }());
+    return pool;
+  }
+
+  usize num_threads() const
+  {
+    return workers_.size();
+  }
+
+  /// Run a and b, potentially in parallel, returns when both have completed. Exceptions from
+  /// either are rethrown here, after both finished.
+  template <typename A, typename B>
+  void join(A&& a, B&& b)
+  {
+    if (current_pool() != this)
+    {
+      // Not on one of our workers, hand the join to the pool and block until it is done.
+      run_in_pool([&]() { join(a, b); });
+      return;
+    }
+
+    const usize me = current_index();
+    StackJob<B> job_b{ b };
+    push(*queues_[me], job_b.as_job());
+
+    std::exception_ptr error_a;
+    try
+    {
+      a();
+    }
+    catch (...)
+    {
+      error_a = std::current_exception();
+    }
+
+    if (pop_if_back(*queues_[me], &job_b))
+    {
+      StackJob<B>::execute(&job_b);
+    }
+    else
+    {
+      // b was stolen, help out with other work until it is finished.
+      while (!job_b.done_.load(std::memory_order_acquire))
+      {
+        if (auto job = find_job(me); job.data != nullptr)
+        {
+          job.execute(job.data);
+        }
+        else
+        {
+          std::this_thread::yield();
+        }
+      }
+    }
+
+    if (error_a)
+    {
+      std::rethrow_exception(error_a);
+    }
+    if (job_b.error_)
+    {
+      std::rethrow_exception(job_b.error_);
+    }
+  }
+
+private:
+  struct Job
+  {
+    void (*execute)(void*) = nullptr;
+    void* data = nullptr;
+  };
+
+  struct Queue
+  {
+    std::mutex mutex;
+    std::deque<Job> jobs;
+  };
+
+  /// A job living on the stack of the thread that waits for it.
+  template <typename F>
+  struct StackJob
+  {
+    F& f_;
+    std::atomic<bool> done_{ false };
+    std::exception_ptr error_{};
+
+    static void execute(void* p)
+    {
+      auto* self = static_cast<StackJob<F>*>(p);
+      try
+      {
+        self->f_();
+      }
+      catch (...)
+      {
+        self->error_ = std::current_exception();
+      }
+      self->done_.store(true, std::memory_order_release);
+    }
+
+    Job as_job()
+    {
+      return Job{ &StackJob<F>::execute, this };
+    }
+  };
+
+  /// A job submitted from outside the pool, the submitter sleeps until it is completed.
+  template <typename F>
+  struct LatchJob
+  {
+    F& f_;
+    std::mutex mutex_{};
+    std::condition_variable cv_{};
+    bool done_{ false };
+    std::exception_ptr error_{};
+
+    static void execute(void* p)
+    {
+      auto* self = static_cast<LatchJob<F>*>(p);
+      try
+      {
+        self->f_();
+      }
+      catch (...)
+      {
+        self->error_ = std::current_exception();
+      }
+      // Notify while holding the lock, the waiter destroys this job as soon as it can lock.
+      std::lock_guard<std::mutex> lock(self->mutex_);
+      self->done_ = true;
+      self->cv_.notify_one();
+    }
+  };
+
+  template <typename F>
+  void run_in_pool(F&& f)
+  {
+    LatchJob<F> job{ f };
+    push(injector_, Job{ &LatchJob<F>::execute, &job });
+    std::unique_lock<std::mutex> lock(job.mutex_);
+    job.cv_.wait(lock, [&job]() { return job.done_; });
+    if (job.error_)
+    {
+      std::rethrow_exception(job.error_);
+    }
+  }
+
+  static ThreadPool*& current_pool()
+  {
+    static thread_local ThreadPool* pool = nullptr;
+    return pool;
+  }
+
+  static usize& current_index()
+  {
+    static thread_local usize index = 0;
+    return index;
+  }
+
+  void push(Queue& queue, Job job)
+  {
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.jobs.push_back(job);
+    }
+    {
+      // Under the sleep lock, such that a worker about to sleep can't miss this job.
+      std::lock_guard<std::mutex> lock(sleep_mutex_);
+      pending_++;
+    }
+    sleep_cv_.notify_one();
+  }
+
+  bool pop_if_back(Queue& queue, void* data)
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.jobs.empty() && queue.jobs.back().data == data)
+    {
+      queue.jobs.pop_back();
+      pending_--;
+      return true;
+    }
+    return false;
+  }
+
+  Job take(Queue& queue, bool back)
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.jobs.empty())
+    {
+      return Job{};
+    }
+    Job job;
+    if (back)
+    {
+      job = queue.jobs.back();
+      queue.jobs.pop_back();
+    }
+    else
+    {
+      job = queue.jobs.front();
+      queue.jobs.pop_front();
+    }
+    pending_--;
+    return job;
+  }
+
+  Job find_job(usize me)
+  {
+    if (auto job = take(*queues_[me], true); job.data != nullptr)
+    {
+      return job;
+    }
+    if (auto job = take(injector_, false); job.data != nullptr)
+    {
+      return job;
+    }
+    for (usize k = 1; k < queues_.size(); k++)
+    {
+      if (auto job = take(*queues_[(me + k) % queues_.size()], false); job.data != nullptr)
+      {
+        return job;
+      }
+    }
+    return Job{};
+  }
+
+  void worker_loop(usize index)
+  {
+    current_pool() = this;
+    current_index() = index;
+    while (true)
+    {
+      if (auto job = find_job(index); job.data != nullptr)
+      {
+        job.execute(job.data);
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(sleep_mutex_);
+      sleep_cv_.wait(lock, [this]() { return stop_ || pending_ > 0; });
+      if (stop_)
+      {
+        return;
+      }
+    }
+  }
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  Queue injector_;
+  std::vector<std::thread> workers_;
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_cv_;
+  std::atomic<usize> pending_{ 0 };
+  bool stop_{ false };
+};
+
+/// Split [lo, hi) in halves until it is at most grain long, run leaf() on the pieces in parallel
+/// and combine the results in order with reduce().
+template <typename Acc, typename Leaf, typename Reduce>
+Acc par_bridge(ThreadPool& pool, usize lo, usize hi, usize grain, const Leaf& leaf, const Reduce& reduce)
+{
+  if (hi - lo <= grain)
+  {
+    return leaf(lo, hi);
+  }
+  const usize mid = lo + (hi - lo) / 2;
+  Option<Acc> left;
+  Option<Acc> right;
+  pool.join([&]() { left = Option<Acc>(par_bridge<Acc>(pool, lo, mid, grain, leaf, reduce)); },
+            [&]() { right = Option<Acc>(par_bridge<Acc>(pool, mid, hi, grain, leaf, reduce)); });
+  return reduce(std::move(left).unwrap(), std::move(right).unwrap());
+}
+
+// Producers hand out the values for an index range of a parallel iterator. for_each_range calls
+// g with each value until g returns false, and returns whether it ran to completion.
+
+/// Producer over the elements of a slice, yielding a Ref or RefMut for each.
+template <typename Wrapper, typename Element>
+struct SliceProducer
+{
+  usize len() const
+  {
+    return len_;
+  }
+
+  template <typename G>
+  bool for_each_range(usize lo, usize hi, G& g) const
+  {
+    for (usize i = lo; i < hi; i++)
+    {
+      if (!g(Wrapper(begin_ + i)))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  Element* begin_;
+  usize len_;
+};
+
+template <typename Upstream, typename F>
+struct ParMap
+{
+  usize len() const
+  {
+    return upstream_.len();
+  }
+
+  template <typename G>
+  bool for_each_range(usize lo, usize hi, G& g) const
+  {
+    auto inner = [this, &g](auto&& v) { return g(invoke_or_unit(f_, v)); };
+    return upstream_.for_each_range(lo, hi, inner);
+  }
+
+  Upstream upstream_;
+  F f_;
+};
+
+template <typename Upstream, typename P>
+struct ParFilter
+{
+  usize len() const
+  {
+    return upstream_.len();
+  }
+
+  template <typename G>
+  bool for_each_range(usize lo, usize hi, G& g) const
+  {
+    auto inner = [this, &g](auto&& v) { return p_(std::as_const(v)) ? g(std::move(v)) : true; };
+    return upstream_.for_each_range(lo, hi, inner);
+  }
+
+  Upstream upstream_;
+  P p_;
+};
+
+/// Parallel iterator, splits its producer recursively over the threads of the global ThreadPool.
+/// Adapters and terminators mirror Iterator, closures are invoked concurrently and must be safe
+/// to call from multiple threads at once.
+template <typename T, typename Producer>
+struct ParIter
+{
+  using type = T;
+  using value_type = std::remove_cvref_t<decltype(deref(std::declval<T>()))>;
+
+  template <std::invocable<T> F>
+  auto map(F&& f) &&
+  {
+    using U = TypeOrUnit<typename std::invoke_result_t<F, T>>;
+    using P = ParMap<Producer, std::decay_t<F>>;
+    return ParIter<U, P>{ P{ std::move(producer_), std::forward<F>(f) }, min_len_ };
+  }
+
+  template <std::predicate<const T&> F>
+  auto filter(F&& f) &&
+  {
+    using P = ParFilter<Producer, std::decay_t<F>>;
+    return ParIter<T, P>{ P{ std::move(producer_), std::forward<F>(f) }, min_len_ };
+  }
+
+  /// Don't split into pieces shorter than n elements.
+  auto with_min_len(usize n) &&
+  {
+    min_len_ = std::max<usize>(n, 1);
+    return std::move(*this);
+  }
+
+  template <std::invocable<T> F>
+  void for_each(F&& f) &&
+  {
+    bridge<Unit>(
+        [&](usize lo, usize hi)
+        {
+          auto g = [&f](auto&& v)
+          {
+            f(std::move(v));
+            return true;
+          };
+          producer_.for_each_range(lo, hi, g);
+          return Unit{};
+        },
+        [](Unit, Unit) { return Unit{}; });
+  }
+
+  usize count() &&
+  {
+    return bridge<usize>(
+        [&](usize lo, usize hi)
+        {
+          usize c = 0;
+          auto g = [&c](auto&&)
+          {
+            c++;
+            return true;
+          };
+          producer_.for_each_range(lo, hi, g);
+          return c;
+        },
+        [](usize a, usize b) { return a + b; });
+  }
+
+  /// Sum of the (dereferenced) values.
+  auto sum() && requires Add<value_type, value_type>
+  {
+    return bridge<value_type>(
+        [&](usize lo, usize hi)
+        {
+          value_type s{};
+          auto g = [&s](auto&& v)
+          {
+            s = s + deref(v);
+            return true;
+          };
+          producer_.for_each_range(lo, hi, g);
+          return s;
+        },
+        [](value_type a, value_type b) -> value_type { return a + b; });
+  }
+
+  /// Whether f holds for any value, stops all threads early once one is found.
+  template <std::predicate<T> F>
+  bool any(F&& f) &&
+  {
+    std::atomic<bool> found{ false };
+    bridge<Unit>(
+        [&](usize lo, usize hi)
+        {
+          auto g = [&](auto&& v)
+          {
+            if (found.load(std::memory_order_relaxed))
+            {
+              return false;
+            }
+            if (f(std::move(v)))
+            {
+              found.store(true, std::memory_order_relaxed);
+              return false;
+            }
+            return true;
+          };
+          producer_.for_each_range(lo, hi, g);
+          return Unit{};
+        },
+        [](Unit, Unit) { return Unit{}; });
+    return found.load();
+  }
+
+  /// The smallest (dereferenced) value, the first one if several are equally small.
+  Option<value_type> min() && requires std::totally_ordered<value_type>
+  {
+    return std::move(*this).extreme([](const value_type& candidate, const value_type& best) { return candidate < best; });
+  }
+
+  /// The largest (dereferenced) value, the last one if several are equally large.
+  Option<value_type> max() && requires std::totally_ordered<value_type>
+  {
+    return std::move(*this).extreme([](const value_type& candidate, const value_type& best) { return candidate >= best; });
+  }
+
+  /// Collect the (dereferenced) values into a std::vector or Vec, keeping their order.
+  template <typename Container = std::vector<value_type>>
+  Container collect() &&
+  {
+    using A = typename Container::value_type;
+    using Pieces = std::list<std::vector<A>>;
+    auto pieces = bridge<Pieces>(
+        [&](usize lo, usize hi)
+        {
+          std::vector<A> piece;
+          auto g = [&piece](auto&& v)
+          {
+            piece.push_back(deref(std::move(v)));
+            return true;
+          };
+          producer_.for_each_range(lo, hi, g);
+          Pieces p;
+          p.push_back(std::move(piece));
+          return p;
+        },
+        [](Pieces a, Pieces b)
+        {
+          a.splice(a.end(), b);
+          return a;
+        });
+    usize total = 0;
+    for (const auto& piece : pieces)
+    {
+      total += piece.size();
+    }
+    std::vector<A> result;
+    result.reserve(total);
+    for (auto& piece : pieces)
+    {
+      std::move(piece.begin(), piece.end(), std::back_inserter(result));
+    }
+    return Container(std::move(result));
+  }
+
+  Producer producer_;
+  usize min_len_{ 1024 };
+
+private:
+  template <typename Acc, typename Leaf, typename Reduce>
+  Acc bridge(const Leaf& leaf, const Reduce& reduce)
+  {
+    auto& pool = ThreadPool::global();
+    const usize n = producer_.len();
+    const usize grain = std::max<usize>(min_len_, n / (pool.num_threads() * 8));
+    if (n <= grain)
+    {
+      return leaf(0, n);
+    }
+    return par_bridge<Acc>(pool, 0, n, grain, leaf, reduce);
+  }
+
+  template <typename Better>
+  Option<value_type> extreme(Better better) &&
+  {
+    const auto pick = [&better](Option<value_type> best, Option<value_type> candidate)
+    {
+      if (candidate.is_some() &&
+          (best.is_none() || better(candidate.as_ref().unwrap().deref(), best.as_ref().unwrap().deref())))
+      {
+        return candidate;
+      }
+      return best;
+    };
+    return bridge<Option<value_type>>(
+        [&](usize lo, usize hi)
+        {
+          Option<value_type> best;
+          auto g = [&](auto&& v)
+          {
+            best = pick(std::move(best), Option<value_type>(deref(v)));
+            return true;
+          };
+          producer_.for_each_range(lo, hi, g);
+          return best;
+        },
+        pick);
+  }
+};
+
+/// Sort [data, data + n) in parallel; halves are sorted concurrently and merged through buf, which
+/// is uninitialized storage for n values, such that T needn't be default constructible.
+template <typename T, typename Less>
+void par_merge_sort(ThreadPool& pool, T* data, T* buf, usize n, usize grain, const Less& less)
+{
+  if (n <= grain)
+  {
+    std::stable_sort(data, data + n, less);
+    return;
+  }
+  const usize mid = n / 2;
+  pool.join([&]() { par_merge_sort(pool, data, buf, mid, grain, less); },
+            [&]() { par_merge_sort(pool, data + mid, buf + mid, n - mid, grain, less); });
+  T* left = data;
+  T* right = data + mid;
+  T* out = buf;
+  while (left != data + mid && right != data + n)
+  {
+    // Equal values are taken from the left first, which keeps the sort stable.
+    std::construct_at(out++, std::move(less(*right, *left) ? *right++ : *left++));
+  }
+  out = std::uninitialized_move(left, data + mid, out);
+  std::uninitialized_move(right, data + n, out);
+  std::move(buf, buf + n, data);
+  std::destroy(buf, buf + n);
+}
+
+/// In place parallel quicksort, the partitions on either side of the pivot are sorted concurrently.
+template <typename T, typename Less>
+void par_quick_sort(ThreadPool& pool, T* data, usize n, usize grain, usize depth, const Less& less)
+{
+  if (n <= grain || depth == 0)
+  {
+    std::sort(data, data + n, less);
+    return;
+  }
+  // Median of three as pivot. It is swapped to the front and compared in place, no copy is made,
+  // such that move-only values can be sorted.
+  const usize a = 0;
+  const usize b = n / 2;
+  const usize c = n - 1;
+  const usize median = less(data[a], data[b]) ? (less(data[b], data[c]) ? b : (less(data[a], data[c]) ? c : a))
+                                              : (less(data[a], data[c]) ? a : (less(data[b], data[c]) ? c : b));
+  std::swap(data[0], data[median]);
+  // Three way partition, such that runs of equal elements don't degrade the recursion. The pivot
+  // is moved between the lower part and the rest, where the second partition doesn't touch it.
+  T* lower_end = std::partition(data + 1, data + n, [&](const T& v) { return less(v, data[0]); });
+  T* pivot = lower_end - 1;
+  std::swap(data[0], *pivot);
+  T* equal_end = std::partition(pivot + 1, data + n, [&](const T& v) { return !less(*pivot, v); });
+  pool.join([&]() { par_quick_sort(pool, data, static_cast<usize>(pivot - data), grain, depth - 1, less); },
+            [&]() { par_quick_sort(pool, equal_end, static_cast<usize>(data + n - equal_end), grain, depth - 1, less); });
+}
+
+inline usize par_sort_grain(ThreadPool& pool, usize n)
+{
+  return std::max<usize>(n / (pool.num_threads() * 4), 4096);
+}
+
+template <typename T>
+concept RadixSortable = (std::is_integral_v<T> || std::is_floating_point_v<T>) && !std::is_const_v<T> &&
+                        (sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8);
+
+/// Map a value onto an unsigned integer with the same ordering, for radix sorting.
+template <RadixSortable T>
+auto radix_key(T v)
+{
+  using Key = std::conditional_t<sizeof(T) == 1, u8,
+                                 std::conditional_t<sizeof(T) == 2, u16, std::conditional_t<sizeof(T) == 4, u32, u64>>>;
+  static_assert(sizeof(Key) == sizeof(T), "no radix key for this type");
+  constexpr Key sign_bit = Key{ 1 } << (sizeof(Key) * 8 - 1);
+  if constexpr (std::is_floating_point_v<T>)
+  {
+    // Negative floats are ordered in reverse by their bits, flip all of them, otherwise only the sign.
+    const Key bits = std::bit_cast<Key>(v);
+    return static_cast<Key>((bits & sign_bit) ? ~bits : (bits | sign_bit));
+  }
+  else if constexpr (std::is_signed_v<T>)
+  {
+    return static_cast<Key>(static_cast<Key>(v) ^ sign_bit);
+  }
+  else
+  {
+    return static_cast<Key>(v);
+  }
+}
+
+/// Least significant digit radix sort over bytes, passes where all keys share a digit are skipped.
+template <RadixSortable T>
+void radix_sort(T* data, usize n)
+{
+  if (n < 2)
+  {
+    return;
+  }
+  constexpr usize digits = sizeof(T);
+  std::vector<std::array<usize, 256>> counts(digits);
+  for (auto& c : counts)
+  {
+    c.fill(0);
+  }
+  for (usize i = 0; i < n; i++)
+  {
+    const auto key = radix_key(data[i]);
+    for (usize d = 0; d < digits; d++)
+    {
+      counts[d][(key >> (8 * d)) & 0xFF]++;
+    }
+  }
+
+  std::vector<T> buffer(n);
+  T* from = data;
+  T* to = buffer.data();
+  for (usize d = 0; d < digits; d++)
+  {
+    auto& count = counts[d];
+    if (std::find(count.begin(), count.end(), n) != count.end())
+    {
+      continue;
+    }
+    usize offset = 0;
+    for (auto& c : count)
+    {
+      const usize bucket = c;
+      c = offset;
+      offset += bucket;
+    }
+    for (usize i = 0; i < n; i++)
+    {
+      to[count[(radix_key(from[i]) >> (8 * d)) & 0xFF]++] = from[i];
+    }
+    std::swap(from, to);
+  }
+  if (from != data)
+  {
+    std::copy(from, from + n, data);
+  }
+}
+
+/// Next function for chunks(), yields subslices of size n, the last one may be shorter.
+template <typename T>
+struct ChunksNext
+{
+  Option<Slice<T>> operator()()
+  {
+    if (len_ == 0)
+    {
+      return Option<Slice<T>>();
+    }
+    const usize n = std::min(n_, len_);
+    auto chunk = Slice<T>::from_raw_parts(data_, n);
+    data_ += n;
+    len_ -= n;
+    return Option<Slice<T>>(chunk);
+  }
+
+  Option<Slice<T>> next_back()
+  {
+    if (len_ == 0)
+    {
+      return Option<Slice<T>>();
+    }
+    const usize n = len_ % n_ == 0 ? n_ : len_ % n_;
+    len_ -= n;
+    return Option<Slice<T>>(Slice<T>::from_raw_parts(data_ + len_, n));
+  }
+
+  usize advance_by(usize k)
+  {
+    const usize step = std::min(k, len());
+    const usize elements = std::min(step * n_, len_);
+    data_ += elements;
+    len_ -= elements;
+    return k - step;
+  }
+
+  usize len() const
+  {
+    return (len_ + n_ - 1) / n_;
+  }
+
+  SizeHint size_hint() const
+  {
+    return exact_size_hint(len());
+  }
+
+  T* data_;
+  usize len_;
+  usize n_;
+};
+
+/// Next function for chunks_exact(), yields subslices of exactly n, the elements that don't fill
+/// a chunk are the remainder.
+template <typename T>
+struct ChunksExactNext
+{
+  Option<Slice<T>> operator()()
+  {
+    if (len_ == 0)
+    {
+      return Option<Slice<T>>();
+    }
+    auto chunk = Slice<T>::from_raw_parts(data_, n_);
+    data_ += n_;
+    len_ -= n_;
+    return Option<Slice<T>>(chunk);
+  }
+
+  Option<Slice<T>> next_back()
+  {
+    if (len_ == 0)
+    {
+      return Option<Slice<T>>();
+    }
+    len_ -= n_;
+    return Option<Slice<T>>(Slice<T>::from_raw_parts(data_ + len_, n_));
+  }
+
+  usize advance_by(usize k)
+  {
+    const usize step = std::min(k, len());
+    data_ += step * n_;
+    len_ -= step * n_;
+    return k - step;
+  }
+
+  usize len() const
+  {
+    return len_ / n_;
+  }
+
+  SizeHint size_hint() const
+  {
+    return exact_size_hint(len());
+  }
+
+  Slice<T> remainder() const
+  {
+    return remainder_;
+  }
+
+  T* data_;
+  usize len_;  // always a multiple of n_
+  usize n_;
+  Slice<T> remainder_;
+};
+
+/// Next function for rchunks(), yields subslices of size n from the back, the last one may be shorter.
+template <typename T>
+struct RChunksNext
+{
+  Option<Slice<T>> operator()()
+  {
+    if (len_ == 0)
+    {
+      return Option<Slice<T>>();
+    }
+    const usize n = std::min(n_, len_);
+    len_ -= n;
+    return Option<Slice<T>>(Slice<T>::from_raw_parts(data_ + len_, n));
+  }
+
+  Option<Slice<T>> next_back()
+  {
+    if (len_ == 0)
+    {
+      return Option<Slice<T>>();
+    }
+    const usize n = len_ % n_ == 0 ? n_ : len_ % n_;
+    auto chunk = Slice<T>::from_raw_parts(data_, n);
+    data_ += n;
+    len_ -= n;
+    return Option<Slice<T>>(chunk);
+  }
+
+  usize advance_by(usize k)
+  {
+    const usize step = std::min(k, len());
+    len_ -= std::min(step * n_, len_);
+    return k - step;
+  }
+
+  usize len() const
+  {
+    return (len_ + n_ - 1) / n_;
+  }
+
+  SizeHint size_hint() const
+  {
+    return exact_size_hint(len());
+  }
+
+  T* data_;
+  usize len_;
+  usize n_;
+};
+
+/// Next function for windows(), yields every overlapping subslice of size n.
+template <typename T>
+struct WindowsNext
+{
+  Option<Slice<T>> operator()()
+  {
+    if (len_ < n_)
+    {
+      return Option<Slice<T>>();
+    }
+    auto window = Slice<T>::from_raw_parts(data_, n_);
+    data_++;
+    len_--;
+    return Option<Slice<T>>(window);
+  }
+
+  Option<Slice<T>> next_back()
+  {
+    if (len_ < n_)
+    {
+      return Option<Slice<T>>();
+    }
+    len_--;
+    return Option<Slice<T>>(Slice<T>::from_raw_parts(data_ + len_ + 1 - n_, n_));
+  }
+
+  usize advance_by(usize k)
+  {
+    const usize step = std::min(k, len());
+    data_ += step;
+    len_ -= step;
+    return k - step;
+  }
+
+  usize len() const
+  {
+    return len_ < n_ ? 0 : len_ - n_ + 1;
+  }
+
+  SizeHint size_hint() const
+  {
+    return exact_size_hint(len());
+  }
+
+  T* data_;
+  usize len_;
+  usize n_;
+};
+
+/// Hint the cache to load the line holding p, a no-op on compilers without the builtin.
+inline void prefetch(const void* p)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(p);
+#else
+  (void)p;
+#endif
+}
+
+/// The number of leading elements for which pred holds, pred must hold for a prefix of the slice.
+/// Every step halves the range with a conditional move instead of a branch, so the loop runs the
+/// same number of times for any outcome and the branch predictor has nothing to miss. The two
+/// possible midpoints of the next step are prefetched.
+template <typename T, typename P>
+usize partition_point_branchless(const T* data, usize n, P& pred)
+{
+  if (n == 0)
+  {
+    return 0;
+  }
+  const T* base = data;
+  while (n > 1)
+  {
+    const usize half = n / 2;
+    prefetch(base + half / 2);
+    prefetch(base + half + half / 2);
+    base = pred(base[half]) ? base + half : base;
+    n -= half;
+  }
+  return static_cast<usize>(base - data) + (pred(*base) ? 1 : 0);
+}
+
+/// The lower bounds of up to Batch needles, like partition_point_branchless. All searches take the
+/// same steps, so they run in lockstep and the cache misses of one overlap with the others.
+template <usize Batch, typename T>
+void lower_bounds_interleaved(const T* data, usize n, const T* needles, usize count, usize* out)
+{
+  if (n == 0)
+  {
+    std::fill(out, out + count, 0);
+    return;
+  }
+  std::array<const T*, Batch> base;
+  base.fill(data);
+  while (n > 1)
+  {
+    const usize half = n / 2;
+    for (usize k = 0; k < count; k++)
+    {
+      prefetch(base[k] + half / 2);
+      prefetch(base[k] + half + half / 2);
+    }
+    for (usize k = 0; k < count; k++)
+    {
+      base[k] = base[k][half] < needles[k] ? base[k] + half : base[k];
+    }
+    n -= half;
+  }
+  for (usize k = 0; k < count; k++)
+  {
+    out[k] = static_cast<usize>(base[k] - data) + (*base[k] < needles[k] ? 1 : 0);
+  }
+}
+
+/// Rust's definition of ASCII whitespace, space, tab, line feed, form feed and carriage return.
+inline bool is_ascii_whitespace(char c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\f' || c == '\r';
+}
+
+/// Index of the first occurrence of a single character pattern, memchr does the scanning.
+inline usize find_pattern(const char* p, usize n, char pattern)
+{
+  return find_index(p, n, pattern);
+}
+
+/// Index of the first occurrence of a string pattern, memchr finds candidates for its first character.
+inline usize find_pattern(const char* p, usize n, Slice<const char> pattern);
+
+inline usize pattern_len(char)
+{
+  return 1;
+}
+
+/// Next function for split() and splitn(), yields the subslices between occurrences of the pattern.
+template <typename T, typename Pattern>
+struct SplitNext
+{
+  Option<Slice<T>> operator()()
+  {
+    if (finished_ || max_ == 0)
+    {
+      return Option<Slice<T>>();
+    }
+    max_--;
+    const usize i = max_ == 0 ? len_ : find_pattern(data_, len_, pattern_);
+    auto piece = Slice<T>::from_raw_parts(data_, i);
+    if (i == len_)
+    {
+      finished_ = true;
+      return Option<Slice<T>>(piece);
+    }
+    const usize skip = i + pattern_len(pattern_);
+    data_ += skip;
+    len_ -= skip;
+    return Option<Slice<T>>(piece);
+  }
+
+  SizeHint size_hint() const
+  {
+    return finished_ || max_ == 0 ? exact_size_hint(0) : SizeHint(1, Option<usize>(std::min(max_, len_ + 1)));
+  }
+
+  T* data_;
+  usize len_;
+  Pattern pattern_;
+  usize max_{ std::numeric_limits<usize>::max() };
+  bool finished_{ false };
+};
+
+/// Next function for split_whitespace(), yields the non empty runs between ASCII whitespace.
+template <typename T>
+struct SplitWhitespaceNext
+{
+  Option<Slice<T>> operator()()
+  {
+    usize start = 0;
+    while (start < len_ && is_ascii_whitespace(data_[start]))
+    {
+      start++;
+    }
+    usize end = start;
+    while (end < len_ && !is_ascii_whitespace(data_[end]))
+    {
+      end++;
+    }
+    auto word = Slice<T>::from_raw_parts(data_ + start, end - start);
+    data_ += end;
+    len_ -= end;
+    return word.len() == 0 ? Option<Slice<T>>() : Option<Slice<T>>(word);
+  }
+
+  SizeHint size_hint() const
+  {
+    return SizeHint(0, Option<usize>((len_ + 1) / 2));
+  }
+
+  T* data_;
+  usize len_;
+};
+
+/// Next function for lines(), splits at line feeds and drops a carriage return before them. A
+/// line feed at the end doesn't start another, empty, line.
+template <typename T>
+struct LinesNext
+{
+  Option<Slice<T>> operator()()
+  {
+    if (len_ == 0)
+    {
+      return Option<Slice<T>>();
+    }
+    const usize i = find_pattern(data_, len_, '\n');
+    usize line_len = i;
+    if (i != len_ && i > 0 && data_[i - 1] == '\r')
+    {
+      line_len--;
+    }
+    auto line = Slice<T>::from_raw_parts(data_, line_len);
+    const usize skip = std::min(i + 1, len_);
+    data_ += skip;
+    len_ -= skip;
+    return Option<Slice<T>>(line);
+  }
+
+  SizeHint size_hint() const
+  {
+    return SizeHint(len_ == 0 ? 0 : 1, Option<usize>(len_));
+  }
+
+  T* data_;
+  usize len_;
+};
+
+template <typename Child, typename Z>
+struct SliceInterface;
+
+template <typename T>
+struct Slice : SliceInterface<Slice<T>, T>
+{
+  using type = T;
+
+  static Slice<T> from_raw_parts(T* data, usize len)
+  {
+    Slice<T> res;
+    res.begin_ = data;
+    res.len_ = len;
+    return res;
+  }
+
+  T* _begin() const
+  {
+    return begin_;
+  }
+  usize _len() const
+  {
+    return len_;
+  }
+
+private:
+  T* begin_{ nullptr };
+  std::size_t len_{ 0 };
+};
+
+template <typename Child, typename T>
+struct SliceInterface
+{
+  usize len() const
+  {
+    return child()._len();
+  }
+
+  T& operator[](usize index)
+  {
+    if (index >= len())
+    {
+      throw panic_error("out of bounds access");
+    }
+    return begin()[index];
+  }
+
+  const T& operator[](usize index) const
+  {
+    if (index >= len())
+    {
+      throw panic_error("out of bounds access");
+    }
+    return begin()[index];
+  }
+
+  /// Access without bounds check, index must be smaller than len().
+  const T& get_unchecked(usize index) const
+  {
+    return begin()[index];
+  }
+
+  T& get_unchecked_mut(usize index)
+  {
+    return begin()[index];
+  }
+
+  Option<Ref<T>> last() const
+  {
+    if (len() > 0)
+    {
+      return Option<Ref<T>>(Ref<T>(&get_unchecked(len() - 1)));
+    }
+    return Option<Ref<T>>();
+  }
+
+  Option<Ref<T>> first() const
+  {
+    if (len() > 0)
+    {
+      return Option<Ref<T>>(Ref<T>(&get_unchecked(0)));
+    }
+    return Option<Ref<T>>();
+  }
+
+  Option<RefMut<T>> first_mut()
+  {
+    if (len() > 0)
+    {
+      return Option<RefMut<T>>(RefMut<T>(&get_unchecked_mut(0)));
+    }
+    return Option<RefMut<T>>();
+  }
+
+  /// Take a subslice
+  template <typename A = std::initializer_list<int>, typename B = std::initializer_list<int>>
+  Slice<T> operator()(A a, B b) const
+  {
+    using std::to_string;
+    usize start = 0;
+    usize end = len();
+    if constexpr (!std::is_same<A, std::initializer_list<int>>::value)
+    {
+      start = a;
+    }
+    if constexpr (!std::is_same<B, std::initializer_list<int>>::value)
+    {
+      end = b;
+    }
+    if (start > end)
+    {
+      throw panic_error("slice index  starts at " + to_string(start) + " but ends at " + to_string(end));
+    }
+    if (end > len())
+    {
+      throw panic_error("range end index " + to_string(end) + " out of range for slice of length " + to_string(len()));
+    }
+
+    return Slice<T>::from_raw_parts(begin() + start, end - start);
+  }
+
+  auto iter() const
+  {
+    auto start = begin();
+    auto end = begin() + len();
+
+    using Wrapper = RefWrapper<const T>;
+    return detail::make_iterator<Wrapper>(RangeNext<T*, Wrapper>{ start, end }, len());
+  }
+
+  /// Split into two slices at mid, the first holds the elements before mid.
+  Tuple<Slice<T>, Slice<T>> split_at(usize mid) const
+  {
+    if (mid > len())
+    {
+      throw panic_error("mid " + std::to_string(mid) + " out of range for slice of length " + std::to_string(len()));
+    }
+    return Tuple<Slice<T>, Slice<T>>(Slice<T>::from_raw_parts(begin(), mid),
+                                     Slice<T>::from_raw_parts(begin() + mid, len() - mid));
+  }
+
+  /// Iterate over subslices of n elements, the last one holds what is left and may be shorter.
+  auto chunks(usize n) const
+  {
+    check_chunk_size(n);
+    return detail::make_iterator<Slice<T>>(ChunksNext<T>{ begin(), len(), n }, (len() + n - 1) / n);
+  }
+
+  /// Iterate over subslices of exactly n elements, the elements that are left over are available
+  /// from remainder() on the iterator. As every chunk is n long, a loop up to n over a chunk can
+  /// use get_unchecked.
+  auto chunks_exact(usize n) const
+  {
+    check_chunk_size(n);
+    const usize exact = len() - len() % n;
+    auto remainder = Slice<T>::from_raw_parts(begin() + exact, len() - exact);
+    return detail::make_iterator<Slice<T>>(ChunksExactNext<T>{ begin(), exact, n, remainder }, exact / n);
+  }
+
+  /// Like chunks(), but starting at the end, the last chunk is at the start of the slice.
+  auto rchunks(usize n) const
+  {
+    check_chunk_size(n);
+    return detail::make_iterator<Slice<T>>(RChunksNext<T>{ begin(), len(), n }, (len() + n - 1) / n);
+  }
+
+  /// Iterate over all overlapping subslices of n elements.
+  auto windows(usize n) const
+  {
+    check_chunk_size(n);
+    return detail::make_iterator<Slice<T>>(WindowsNext<T>{ begin(), len(), n }, len() < n ? 0 : len() - n + 1);
+  }
+
+  /// The index of the first element for which pred doesn't hold, pred must hold for a prefix.
+  template <std::predicate<const T&> P>
+  usize partition_point(P&& pred) const
+  {
+    return partition_point_branchless<T>(begin(), len(), pred);
+  }
+
+  /// Index of the first element not less than x, in a sorted slice.
+  usize lower_bound(const std::remove_cv_t<T>& x) const requires std::totally_ordered<T>
+  {
+    return partition_point([&x](const T& v) { return v < x; });
+  }
+
+  /// Index of the first element greater than x, in a sorted slice.
+  usize upper_bound(const std::remove_cv_t<T>& x) const requires std::totally_ordered<T>
+  {
+    return partition_point([&x](const T& v) { return !(x < v); });
+  }
+
+  /// Search a sorted slice for x, Ok holds the index of the first match, Err the index where x
+  /// could be inserted to keep the slice sorted.
+  Result<usize, usize> binary_search(const std::remove_cv_t<T>& x) const requires std::totally_ordered<T>
+  {
+    const usize i = lower_bound(x);
+    return i < len() && !(x < begin()[i]) ? Result<usize, usize>::Ok(i) : Result<usize, usize>::Err(i);
+  }
+
+  /// Like binary_search, compare returns how an element compares to the target, as a
+  /// std::strong_ordering or an int.
+  template <typename F>
+  Result<usize, usize> binary_search_by(F&& compare) const
+  {
+    const usize i = partition_point([&compare](const T& v) { return compare(v) < 0; });
+    return i < len() && compare(std::as_const(begin()[i])) == 0 ? Result<usize, usize>::Ok(i)
+                                                                 : Result<usize, usize>::Err(i);
+  }
+
+  /// Like binary_search, for a slice sorted by key(element).
+  template <typename K, typename F>
+  Result<usize, usize> binary_search_by_key(const K& k, F&& key) const
+  {
+    return binary_search_by([&k, &key](const T& v) { return key(v) <=> k; });
+  }
+
+  /// binary_search for every needle, the searches are interleaved in batches of 16 to overlap
+  /// their cache misses, which pays off for slices much larger than the cache.
+  template <Borrowable BorrowableType>
+  std::vector<Result<usize, usize>> binary_search_many(const BorrowableType& needles) const
+      requires std::totally_ordered<T>
+  {
+    constexpr usize batch = 16;
+    const auto xs = Borrow<BorrowableType>::borrow(needles);
+    std::vector<Result<usize, usize>> results;
+    results.reserve(xs.len());
+    std::array<usize, batch> found;
+    for (usize i = 0; i < xs.len(); i += batch)
+    {
+      const usize count = std::min(batch, xs.len() - i);
+      lower_bounds_interleaved<batch>(as_ptr(), len(), xs.as_ptr() + i, count, found.data());
+      for (usize k = 0; k < count; k++)
+      {
+        const usize at = found[k];
+        const bool hit = at < len() && !(xs.get_unchecked(i + k) < begin()[at]);
+        results.push_back(hit ? Result<usize, usize>::Ok(at) : Result<usize, usize>::Err(at));
+      }
+    }
+    return results;
+  }
+
+  /// Split at every occurrence of pattern, a char or a string. Empty pieces between adjacent
+  /// patterns and at the ends are kept. The pieces are views into this slice.
+  template <typename Pattern>
+  auto split(const Pattern& pattern) const requires std::same_as<std::remove_cv_t<T>, char>
+  {
+    using Next = SplitNext<T, decltype(text_pattern(pattern))>;
+    return detail::make_iterator<Slice<T>>(Next{ begin(), len(), text_pattern(pattern) }, 0);
+  }
+
+  /// Split at most n - 1 times, the last piece holds the rest of the slice.
+  template <typename Pattern>
+  auto splitn(usize n, const Pattern& pattern) const requires std::same_as<std::remove_cv_t<T>, char>
+  {
+    using Next = SplitNext<T, decltype(text_pattern(pattern))>;
+    return detail::make_iterator<Slice<T>>(Next{ begin(), len(), text_pattern(pattern), n }, 0);
+  }
+
+  /// The parts before and after the first occurrence of pattern.
+  template <typename Pattern>
+  Option<Tuple<Slice<T>, Slice<T>>> split_once(const Pattern& pattern) const
+      requires std::same_as<std::remove_cv_t<T>, char>
+  {
+    const auto p = text_pattern(pattern);
+    const usize i = find_pattern(begin(), len(), p);
+    if (i == len())
+    {
+      return Option<Tuple<Slice<T>, Slice<T>>>();
+    }
+    const usize rest = i + pattern_len(p);
+    return Option<Tuple<Slice<T>, Slice<T>>>(
+        Tuple<Slice<T>, Slice<T>>(Slice<T>::from_raw_parts(begin(), i), Slice<T>::from_raw_parts(begin() + rest, len() - rest)));
+  }
+
+  /// The non empty runs of characters between ASCII whitespace.
+  auto split_whitespace() const requires std::same_as<std::remove_cv_t<T>, char>
+  {
+    return detail::make_iterator<Slice<T>>(SplitWhitespaceNext<T>{ begin(), len() }, 0);
+  }
+
+  /// The lines, ending at a line feed or a carriage return and line feed, which are not included.
+  auto lines() const requires std::same_as<std::remove_cv_t<T>, char>
+  {
+    return detail::make_iterator<Slice<T>>(LinesNext<T>{ begin(), len() }, 0);
+  }
+
+  /// Without leading and trailing ASCII whitespace.
+  Slice<T> trim() const requires std::same_as<std::remove_cv_t<T>, char>
+  {
+    return trim_start().trim_end();
+  }
+
+  Slice<T> trim_start() const requires std::same_as<std::remove_cv_t<T>, char>
+  {
+    usize start = 0;
+    while (start < len() && is_ascii_whitespace(begin()[start]))
+    {
+      start++;
+    }
+    return Slice<T>::from_raw_parts(begin() + start, len() - start);
+  }
+
+  Slice<T> trim_end() const requires std::same_as<std::remove_cv_t<T>, char>
+  {
+    usize end = len();
+    while (end > 0 && is_ascii_whitespace(begin()[end - 1]))
+    {
+      end--;
+    }
+    return Slice<T>::from_raw_parts(begin(), end);
+  }
+
+  /// Parallel iterator over the elements, see ParIter.
+  auto par_iter() const
+  {
+    using Wrapper = RefWrapper<const T>;
+    return ParIter<Wrapper, SliceProducer<Wrapper, T>>{ { begin(), len() } };
+  }
+
+  auto par_iter_mut() const
+  {
+    using Wrapper = RefWrapper<T>;
+    return ParIter<Wrapper, SliceProducer<Wrapper, T>>{ { begin(), len() } };
+  }
+
+  auto iter_mut() const
+  {
+    auto start = begin();
+    auto end = begin() + len();
+    using Wrapper = RefWrapper<T>;
+    return detail::make_iterator<Wrapper>(RangeNext<T*, Wrapper>{ start, end }, len());
+  }
+
+  void sort() requires std::totally_ordered<T>
+  {
+    std::ranges::stable_sort(begin(), begin() + len());
+  }
+
+  /// Sort without keeping the order of equal elements, in place and faster than sort().
+  void sort_unstable() requires std::totally_ordered<T>
+  {
+    std::sort(begin(), begin() + len());
+  }
+
+  /// Stable sort with a comparator that returns an ordering, like a <=> b.
+  template <typename F>
+  void sort_by(F&& compare)
+  {
+    std::stable_sort(begin(), begin() + len(), [&compare](const T& a, const T& b) { return compare(a, b) < 0; });
+  }
+
+  template <typename F>
+  void sort_unstable_by(F&& compare)
+  {
+    std::sort(begin(), begin() + len(), [&compare](const T& a, const T& b) { return compare(a, b) < 0; });
+  }
+
+  /// Stable sort by the key extracted from each element.
+  template <typename F>
+  void sort_by_key(F&& key) requires std::totally_ordered<std::invoke_result_t<F, const T&>>
+  {
+    std::stable_sort(begin(), begin() + len(), [&key](const T& a, const T& b) { return key(a) < key(b); });
+  }
+
+  template <typename F>
+  void sort_unstable_by_key(F&& key) requires std::totally_ordered<std::invoke_result_t<F, const T&>>
+  {
+    std::sort(begin(), begin() + len(), [&key](const T& a, const T& b) { return key(a) < key(b); });
+  }
+
+  /// Stable sort using all threads of the global ThreadPool, merges through uninitialized storage
+  /// for len() values.
+  void par_sort() requires std::totally_ordered<T>
+  {
+    auto& pool = ThreadPool::global();
+    const usize n = len();
+    std::allocator<T> alloc;
+    T* buffer = alloc.allocate(n);
+    try
+    {
+      par_merge_sort(pool, begin(), buffer, n, par_sort_grain(pool, n), std::less<T>{});
+    }
+    catch (...)
+    {
+      alloc.deallocate(buffer, n);
+      throw;
+    }
+    alloc.deallocate(buffer, n);
+  }
+
+  /// Unstable sort using all threads of the global ThreadPool, in place.
+  void par_sort_unstable() requires std::totally_ordered<T>
+  {
+    auto& pool = ThreadPool::global();
+    const usize depth = 2 * std::bit_width(len());
+    par_quick_sort(pool, begin(), len(), par_sort_grain(pool, len()), depth, std::less<T>{});
+  }
+
+  /// LSD radix sort for integer and floating point elements, floats are ordered by total order;
+  /// -0.0 before 0.0 and NaNs at the ends depending on their sign.
+  void radix_sort() requires RadixSortable<T>
+  {
+    detail::radix_sort(begin(), len());
+  }
+
+  template <typename T2>
+  bool operator==(const Slice<T2>& other) const requires std::equality_comparable_with<T, T2>
+  {
+    return len() == other.len() && slice_equal(begin(), other.as_ptr(), len());
+  }
+
+  template <Borrowable BorrowableType>
+  bool starts_with(const BorrowableType& original)
+      const requires std::equality_comparable_with<T, typename Borrow<BorrowableType>::type>
+  {
+    const auto needle = Borrow<BorrowableType>::borrow(original);
+    const auto n = needle.len();
+    return len() >= n && slice_equal(begin(), needle.as_ptr(), n);
+  }
+
+  template <Borrowable BorrowableType>
+  bool ends_with(const BorrowableType& original)
+      const requires std::equality_comparable_with<T, typename Borrow<BorrowableType>::type>
+  {
+    const auto needle = Borrow<BorrowableType>::borrow(original);
+    const auto n = needle.len();
+    return len() >= n && slice_equal(begin() + (len() - n), needle.as_ptr(), n);
+  }
+
+  bool contains(const std::remove_cv_t<T>& x) const requires std::equality_comparable<T>
+  {
+    return find_index(begin(), len(), x) != len();
+  }
+
+  /// Index of the first element equal to x.
+  Option<usize> position(const std::remove_cv_t<T>& x) const requires std::equality_comparable<T>
+  {
+    const usize index = find_index(begin(), len(), x);
+    return index == len() ? Option<usize>() : Option<usize>(index);
+  }
+
+  /// Lexicographically compare with another borrowable sequence.
+  template <Borrowable BorrowableType>
+  auto cmp(const BorrowableType& original) const
+      requires std::three_way_comparable_with<T, typename Borrow<BorrowableType>::type>
+  {
+    using T2 = typename Borrow<BorrowableType>::type;
+    const auto other = Borrow<BorrowableType>::borrow(original);
+    if constexpr (ByteOrdered<T, T2>)
+    {
+      const usize n = std::min(len(), other.len());
+      const int r = n == 0 ? 0 : std::memcmp(begin(), other.as_ptr(), n);
+      return r != 0 ? (r <=> 0) : (len() <=> other.len());
+    }
+    else
+    {
+      return std::lexicographical_compare_three_way(begin(), begin() + len(), other.as_ptr(),
+                                                    other.as_ptr() + other.len());
+    }
+  }
+
+  const T* as_ptr() const
+  {
+    return begin();
+  }
+
+  T* as_mut_ptr()
+  {
+    return begin();
+  }
+
+protected:
+  // Patterns are a single char, or anything that borrows as a string, which is searched as a slice.
+  static char text_pattern(char c)
+  {
+    return c;
+  }
+  template <typename Pattern>
+  static Slice<const char> text_pattern(const Pattern& pattern) requires(!std::same_as<Pattern, char>)
+  {
+    const Slice<const char> p = Borrow<Pattern>::borrow(pattern);
+    if (p.len() == 0)
+    {
+      throw panic_error("split pattern must not be empty");
+    }
+    return p;
+  }
+
+  static void check_chunk_size(usize n)
+  {
+    if (n == 0)
+    {
+      throw panic_error("chunk size must be non-zero");
+    }
+  }
+
+  T* begin() const
+  {
+    // The child may only have a const _begin() for const T, or a const and mutable one like Vec.
+    return const_cast<Child&>(child())._begin();
+  }
+
+private:
+  const Child& child() const
+  {
+    return *static_cast<const Child*>(this);
+  }
+};
+
+inline usize find_pattern(const char* p, usize n, Slice<const char> pattern)
+{
+  const char* needle = pattern.as_ptr();
+  const usize m = pattern.len();
+  usize i = 0;
+  while (i + m <= n)
+  {
+    const usize found = find_index(p + i, n - i - m + 1, needle[0]);
+    if (found == n - i - m + 1)
+    {
+      break;
+    }
+    i += found;
+    if (std::memcmp(p + i + 1, needle + 1, m - 1) == 0)
+    {
+      return i;
+    }
+    i++;
+  }
+  return n;
+}
+
+inline usize pattern_len(Slice<const char> pattern)
+{
+  return pattern.len();
+}
+
+template <typename T>
+std::string to_string(const Slice<T>& slice)
+{
+  std::string s = "[";
+  for (const auto& [i, v] : slice.iter().enumerate())
+  {
+    s += to_string(*v);
+    if (i != slice.len() - 1)
+    {
+      s += ", ";
+    }
+  }
+  s += "]";
+  return s;
+}
+
+/// Make an Slice printable.
+template <typename SS, typename T>
+SS& operator<<(SS& os, const Slice<T>& slice)
+{
+  os << to_string(slice);
+  return os;
+}
+
+/// Next function for Vec::drain(), moves the values of a range out of the vector in place. Once it
+/// is dropped, the values it did not yield are destroyed and the tail is moved down over the gap.
+template <typename T, typename Alloc>
+struct VecDrainNext
+{
+  VecDrainNext(std::vector<T, Alloc>* v, usize start, usize end)
+    : v_(v), start_(start), front_(start), back_(end), end_(end)
+  {
+  }
+
+  // Only the last owner closes the gap.
+  VecDrainNext(VecDrainNext&& o) noexcept
+    : v_(std::exchange(o.v_, nullptr)), start_(o.start_), front_(o.front_), back_(o.back_), end_(o.end_)
+  {
+  }
+  VecDrainNext& operator=(VecDrainNext&&) = delete;
+
+  ~VecDrainNext()
+  {
+    if (v_ != nullptr)
+    {
+      v_->erase(v_->begin() + start_, v_->begin() + end_);
+    }
+  }
+
+  Option<T> operator()()
+  {
+    if (front_ == back_)
+    {
+      return Option<T>();
+    }
+    return Option<T>(std::move((*v_)[front_++]));
+  }
+
+  Option<T> next_back()
+  {
+    if (front_ == back_)
+    {
+      return Option<T>();
+    }
+    return Option<T>(std::move((*v_)[--back_]));
+  }
+
+  template <typename Acc, typename G>
+  Acc fold(Acc acc, G& g)
+  {
+    T* data = v_->data();
+    for (; front_ != back_; front_++)
+    {
+      acc = g(std::move(acc), std::move(data[front_]));
+    }
+    return acc;
+  }
+
+  usize len() const
+  {
+    return back_ - front_;
+  }
+
+  SizeHint size_hint() const
+  {
+    return exact_size_hint(len());
+  }
+
+  std::vector<T, Alloc>* v_;
+  usize start_;
+  usize front_;
+  usize back_;
+  usize end_;
+};
+
+/// Next function for into_iter() on the inline vectors, owns the vector and moves its values out by
+/// index, such that moving the iterator moves the vector with it.
+template <typename C, typename T>
+struct IntoIterNext
+{
+  Option<T> operator()()
+  {
+    if (front_ == back_)
+    {
+      return Option<T>();
+    }
+    return Option<T>(std::move(c_.get_unchecked_mut(front_++)));
+  }
+
+  Option<T> next_back()
+  {
+    if (front_ == back_)
+    {
+      return Option<T>();
+    }
+    return Option<T>(std::move(c_.get_unchecked_mut(--back_)));
+  }
+
+  template <typename Acc, typename G>
+  Acc fold(Acc acc, G& g)
+  {
+    for (; front_ != back_; front_++)
+    {
+      acc = g(std::move(acc), std::move(c_.get_unchecked_mut(front_)));
+    }
+    return acc;
+  }
+
+  usize len() const
+  {
+    return back_ - front_;
+  }
+
+  SizeHint size_hint() const
+  {
+    return exact_size_hint(len());
+  }
+
+  C c_;
+  usize front_;
+  usize back_;
+};
+
+/// A growable array, backed by a std::vector with the allocator Alloc.
+template <typename T, typename Alloc = std::allocator<T>>
+struct Vec : SliceInterface<Vec<T, Alloc>, T>
+{
+  using value_type = T;
+  using allocator_type = Alloc;
+
+  Vec() = default;
+  explicit Vec(const Alloc& alloc) : v_(alloc){};
+  Vec(std::initializer_list<T> v, const Alloc& alloc = Alloc()) : v_(v, alloc){};
+  Vec(const std::vector<T, Alloc>& v) : v_(v){};
+  Vec(std::vector<T, Alloc>&& v) : v_(std::move(v)){};
+
+  /// An empty Vec with room for n values before it allocates again.
+  static Vec<T, Alloc> with_capacity(usize n, const Alloc& alloc = Alloc())
+  {
+    Vec<T, Alloc> v(alloc);
+    v.reserve(n);
+    return v;
+  }
+
+  usize capacity() const
+  {
+    return v_.capacity();
+  }
+
+  bool is_empty() const
+  {
+    return v_.empty();
+  }
+
+  Alloc allocator() const
+  {
+    return v_.get_allocator();
+  }
+
+  void reserve(usize additional)
+  {
+    v_.reserve(v_.size() + additional);
+  }
+
+  void push(T v)
+  {
+    v_.push_back(std::move(v));
+  }
+
+  Option<T> pop()
+  {
+    if (v_.empty())
+    {
+      return Option<T>();
+    }
+    Option<T> v(std::move(v_.back()));
+    v_.pop_back();
+    return v;
+  }
+
+  void clear()
+  {
+    v_.clear();
+  }
+
+  /// Move the values in a range out, the bounds are as for the subslice operator, so drain() or
+  /// drain({}, {}) takes everything and drain(2, {}) everything from index 2. The Vec must not be
+  /// used until the iterator is dropped, which removes the range, yielded or not.
+  template <typename A = std::initializer_list<int>, typename B = std::initializer_list<int>>
+  auto drain(A a = {}, B b = {})
+  {
+    const Slice<T> range = (*this)(a, b);
+    const usize start = static_cast<usize>(range.as_ptr() - v_.data());
+    const usize end = start + range.len();
+    return make_iterator<T>(VecDrainNext<T, Alloc>(&v_, start, end), range.len());
+  }
+
+  /// Consume the Vec into an iterator that owns its buffer and moves the values out.
+  auto into_iter() &&
+  {
+    const usize size = v_.size();
+    return make_iterator<T>(DrainNext<std::vector<T, Alloc>>{ std::move(v_), size }, size);
+  }
+
+  /// Append the values of an iterator or container, references are dereferenced into copies.
+  template <typename It>
+  void extend(It&& it)
+  {
+    if constexpr (HasNext<std::remove_cvref_t<It>>)
+    {
+      extend_back(v_, std::forward<It>(it));
+    }
+    else
+    {
+      extend(rust::into_iter(it));
+    }
+  }
+
+  const T* _begin() const
+  {
+    return v_.data();
+  }
+  T* _begin()
+  {
+    return v_.data();
+  }
+  usize _len() const
+  {
+    return v_.size();
+  }
+
+  // We could implement the full vector interface here, but mehh, we can make our vector act
+  // like it is a std::vector by doing the following;
+  operator std::vector<T, Alloc>&()
+  {
+    return v_;
+  }
+  operator const std::vector<T, Alloc>&() const
+  {
+    return v_;
+  }
+
+private:
+  std::vector<T, Alloc> v_;
+};
+
+template <typename T, typename Alloc>
+std::string to_string(const Vec<T, Alloc>& v)
+{
+  std::string s = "[";
+  for (const auto& [index, value] : v.iter().enumerate())
+  {
+    s += to_string(value);
+    if (index != v.len() - 1)
+    {
+      s += ", ";
+    }
+  }
+  s += "]";
+  return s;
+}
+
+/// Make an Slice printable.
+template <typename SS, typename T, typename Alloc>
+SS& operator<<(SS& os, const Vec<T, Alloc>& v)
+{
+  os << to_string(v);
+  return os;
+}
+
+/// A vector that keeps up to N values inline and never allocates, pushing past N panics. It is
+/// trivially copyable and destructible when T is, so it can be returned and stored like a std::array.
+template <typename T, usize N>
+struct ArrayVec : SliceInterface<ArrayVec<T, N>, T>
+{
+  static_assert(N > 0, "ArrayVec needs room for at least one value");
+  using value_type = T;
+
+  ArrayVec()
+  {
+  }
+  ArrayVec(std::initializer_list<T> v)
+  {
+    for (const T& x : v)
+    {
+      push(x);
+    }
+  }
+
+  ArrayVec(const ArrayVec&) requires std::is_trivially_copy_constructible_v<T>
+  = default;
+  ArrayVec(const ArrayVec& o)
+  {
+    for (usize i = 0; i < o.len_; i++)
+    {
+      push(o.items_[i]);
+    }
+  }
+
+  ArrayVec(ArrayVec&&) requires std::is_trivially_move_constructible_v<T>
+  = default;
+  ArrayVec(ArrayVec&& o) noexcept(std::is_nothrow_move_constructible_v<T>)
+  {
+    for (usize i = 0; i < o.len_; i++)
+    {
+      push(std::move(o.items_[i]));
+    }
+  }
+
+  ArrayVec& operator=(const ArrayVec&) requires(std::is_trivially_copy_assignable_v<T>&& std::
+                                                    is_trivially_copy_constructible_v<T>&& std::
+                                                        is_trivially_destructible_v<T>) = default;
+  ArrayVec& operator=(const ArrayVec& o)
+  {
+    if (this != &o)
+    {
+      clear();
+      for (usize i = 0; i < o.len_; i++)
+      {
+        push(o.items_[i]);
+      }
+    }
+    return *this;
+  }
+
+  ArrayVec& operator=(ArrayVec&&) requires(std::is_trivially_move_assignable_v<T>&& std::
+                                               is_trivially_move_constructible_v<T>&& std::
+                                                   is_trivially_destructible_v<T>) = default;
+  ArrayVec& operator=(ArrayVec&& o) noexcept(std::is_nothrow_move_constructible_v<T>)
+  {
+    if (this != &o)
+    {
+      clear();
+      for (usize i = 0; i < o.len_; i++)
+      {
+        push(std::move(o.items_[i]));
+      }
+    }
+    return *this;
+  }
+
+  ~ArrayVec() requires std::is_trivially_destructible_v<T>
+  = default;
+  ~ArrayVec()
+  {
+    clear();
+  }
+
+  static constexpr usize capacity()
+  {
+    return N;
+  }
+
+  bool is_empty() const
+  {
+    return len_ == 0;
+  }
+
+  bool is_full() const
+  {
+    return len_ == N;
+  }
+
+  void push(T v)
+  {
+    if (len_ == N)
+    {
+      throw panic_error("ArrayVec is full, its capacity is " + std::to_string(N));
+    }
+    std::construct_at(&items_[len_], std::move(v));
+    len_++;
+  }
+
+  /// Push v if there is room, otherwise hand it back as the error.
+  Result<Unit, T> try_push(T v)
+  {
+    if (len_ == N)
+    {
+      return Result<Unit, T>::Err(std::move(v));
+    }
+    std::construct_at(&items_[len_], std::move(v));
+    len_++;
+    return Result<Unit, T>::Ok(Unit{});
+  }
+
+  Option<T> pop()
+  {
+    if (len_ == 0)
+    {
+      return Option<T>();
+    }
+    len_--;
+    Option<T> v(std::move(items_[len_]));
+    std::destroy_at(&items_[len_]);
+    return v;
+  }
+
+  /// Consume the vector into an iterator that owns it and moves the values out.
+  auto into_iter() &&
+  {
+    const usize size = this->len();
+    return make_iterator<T>(IntoIterNext<ArrayVec, T>{ std::move(*this), 0, size }, size);
+  }
+
+  void clear()
+  {
+    if constexpr (!std::is_trivially_destructible_v<T>)
+    {
+      std::destroy(items_, items_ + len_);
+    }
+    len_ = 0;
+  }
+
+  /// Append the values of an iterator or container, panics when they do not fit.
+  template <typename It>
+  void extend(It&& it)
+  {
+    if constexpr (HasNext<std::remove_cvref_t<It>>)
+    {
+      std::move(it).for_each(
+          [this](auto&& x)
+          {
+            if constexpr (std::constructible_from<T, decltype(x)>)
+            {
+              push(std::move(x));
+            }
+            else
+            {
+              push(*x);
+            }
+          });
+    }
+    else
+    {
+      extend(into_iter(it));
+    }
+  }
+
+  const T* _begin() const
+  {
+    return items_;
+  }
+  T* _begin()
+  {
+    return items_;
+  }
+  usize _len() const
+  {
+    return len_;
+  }
+
+private:
+  usize len_{ 0 };
+  union
+  {
+    T items_[N];
+  };
+};
+
+/// A vector that keeps up to N values inline and moves them to the heap once it grows beyond
+/// that, so small collections avoid the allocator altogether.
+template <typename T, usize N>
+struct SmallVec : SliceInterface<SmallVec<T, N>, T>
+{
+  static_assert(N > 0, "SmallVec needs inline room for at least one value");
+  using value_type = T;
+
+  SmallVec()
+  {
+  }
+  SmallVec(std::initializer_list<T> v)
+  {
+    reserve(v.size());
+    for (const T& x : v)
+    {
+      push(x);
+    }
+  }
+  SmallVec(const SmallVec& o)
+  {
+    reserve(o.len_);
+    for (usize i = 0; i < o.len_; i++)
+    {
+      push(o.data_[i]);
+    }
+  }
+  SmallVec(SmallVec&& o) noexcept(std::is_nothrow_move_constructible_v<T>)
+  {
+    take(std::move(o));
+  }
+
+  SmallVec& operator=(const SmallVec& o)
+  {
+    if (this != &o)
+    {
+      clear();
+      reserve(o.len_);
+      for (usize i = 0; i < o.len_; i++)
+      {
+        push(o.data_[i]);
+      }
+    }
+    return *this;
+  }
+  SmallVec& operator=(SmallVec&& o) noexcept(std::is_nothrow_move_constructible_v<T>)
+  {
+    if (this != &o)
+    {
+      release();
+      take(std::move(o));
+    }
+    return *this;
+  }
+
+  ~SmallVec()
+  {
+    release();
+  }
+
+  /// An empty SmallVec with room for n values, it only allocates if n exceeds N.
+  static SmallVec<T, N> with_capacity(usize n)
+  {
+    SmallVec<T, N> v;
+    v.reserve(n);
+    return v;
+  }
+
+  usize capacity() const
+  {
+    return capacity_;
+  }
+
+  /// Whether the values moved to the heap.
+  bool spilled() const
+  {
+    return data_ != inline_;
+  }
+
+  bool is_empty() const
+  {
+    return len_ == 0;
+  }
+
+  void reserve(usize additional)
+  {
+    if (len_ + additional > capacity_)
+    {
+      grow(std::max(len_ + additional, 2 * capacity_));
+    }
+  }
+
+  void push(T v)
+  {
+    if (len_ == capacity_)
+    {
+      grow(2 * capacity_);
+    }
+    std::construct_at(&data_[len_], std::move(v));
+    len_++;
+  }
+
+  Option<T> pop()
+  {
+    if (len_ == 0)
+    {
+      return Option<T>();
+    }
+    len_--;
+    Option<T> v(std::move(data_[len_]));
+    std::destroy_at(&data_[len_]);
+    return v;
+  }
+
+  /// Consume the vector into an iterator that owns it and moves the values out.
+  auto into_iter() &&
+  {
+    const usize size = this->len();
+    return make_iterator<T>(IntoIterNext<SmallVec, T>{ std::move(*this), 0, size }, size);
+  }
+
+  void clear()
+  {
+    std::destroy(data_, data_ + len_);
+    len_ = 0;
+  }
+
+  /// Append the values of an iterator or container, references are dereferenced into copies.
+  template <typename It>
+  void extend(It&& it)
+  {
+    if constexpr (HasNext<std::remove_cvref_t<It>>)
+    {
+      reserve(reserve_hint(it));
+      std::move(it).for_each(
+          [this](auto&& x)
+          {
+            if constexpr (std::constructible_from<T, decltype(x)>)
+            {
+              push(std::move(x));
+            }
+            else
+            {
+              push(*x);
+            }
+          });
+    }
+    else
+    {
+      extend(into_iter(it));
+    }
+  }
+
+  const T* _begin() const
+  {
+    return data_;
+  }
+  T* _begin()
+  {
+    return data_;
+  }
+  usize _len() const
+  {
+    return len_;
+  }
+
+private:
+  void grow(usize capacity)
+  {
+    T* heap = std::allocator<T>().allocate(capacity);
+    try
+    {
+      std::uninitialized_move(data_, data_ + len_, heap);
+    }
+    catch (...)
+    {
+      std::allocator<T>().deallocate(heap, capacity);
+      throw;
+    }
+    const usize len = len_;
+    release();
+    data_ = heap;
+    len_ = len;
+    capacity_ = capacity;
+  }
+
+  // Destroy the values and free the heap buffer, leaving an empty inline vector.
+  void release()
+  {
+    clear();
+    if (spilled())
+    {
+      std::allocator<T>().deallocate(data_, capacity_);
+      data_ = inline_;
+      capacity_ = N;
+    }
+  }
+
+  // Steal the heap buffer of o, or move its inline values over one by one; o is left empty.
+  void take(SmallVec&& o)
+  {
+    if (o.spilled())
+    {
+      data_ = std::exchange(o.data_, o.inline_);
+      len_ = std::exchange(o.len_, 0);
+      capacity_ = std::exchange(o.capacity_, N);
+    }
+    else
+    {
+      for (usize i = 0; i < o.len_; i++)
+      {
+        push(std::move(o.data_[i]));
+      }
+      o.clear();
+    }
+  }
+
+  T* data_{ inline_ };
+  usize len_{ 0 };
+  usize capacity_{ N };
+  union
+  {
+    T inline_[N];
+  };
+};
+
+template <typename T, usize N>
+std::string to_string(const ArrayVec<T, N>& v)
+{
+  return to_string(v({}, {}));
+}
+
+template <typename SS, typename T, usize N>
+SS& operator<<(SS& os, const ArrayVec<T, N>& v)
+{
+  os << to_string(v);
+  return os;
+}
+
+template <typename T, usize N>
+std::string to_string(const SmallVec<T, N>& v)
+{
+  return to_string(v({}, {}));
+}
+
+template <typename SS, typename T, usize N>
+SS& operator<<(SS& os, const SmallVec<T, N>& v)
+{
+  os << to_string(v);
+  return os;
+}
+
+/// A group of control bytes of a HashMap, which are probed at once. A control byte is empty,
+/// deleted or holds the low 7 bits of the hash of a full slot. Bitmasks have one bit per byte with
+/// SSE2, and the top bit of each byte in the portable 8 byte fallback; index() maps both to a slot.
+struct HashGroup
+{
+  static constexpr i8 empty = -128;
+  static constexpr i8 deleted = -2;
+
+#if defined(__SSE2__)
+  static constexpr usize width = 16;
+  static constexpr int shift = 0;
+
+  explicit HashGroup(const i8* ctrl) : ctrl_(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl)))
+  {
+  }
+
+  u32 match(i8 h2) const
+  {
+    return static_cast<u32>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl_)));
+  }
+
+  u32 match_empty() const
+  {
+    return match(empty);
+  }
+
+  // Empty and deleted are the only negative control bytes.
+  u32 match_free() const
+  {
+    return static_cast<u32>(_mm_movemask_epi8(ctrl_));
+  }
+
+private:
+  __m128i ctrl_;
+#else
+  static constexpr usize width = 8;
+  static constexpr int shift = 3;
+  static constexpr u64 lsbs = 0x0101010101010101ULL;
+  static constexpr u64 msbs = 0x8080808080808080ULL;
+
+  explicit HashGroup(const i8* ctrl)
+  {
+    std::memcpy(&ctrl_, ctrl, width);
+  }
+
+  // May report a byte that does not match when a lower one does, the keys are compared anyway.
+  u64 match(i8 h2) const
+  {
+    const u64 x = ctrl_ ^ (lsbs * static_cast<u8>(h2));
+    return (x - lsbs) & ~x & msbs;
+  }
+
+  u64 match_empty() const
+  {
+    return ctrl_ & ~(ctrl_ << 6) & msbs;
+  }
+
+  u64 match_free() const
+  {
+    return ctrl_ & msbs;
+  }
+
+private:
+  u64 ctrl_;
+#endif
+
+public:
+  template <typename Mask>
+  static usize index(Mask mask)
+  {
+    return static_cast<usize>(std::countr_zero(mask)) >> shift;
+  }
+};
+
+/// Next function for HashMap::iter() and iter_mut(), visits the full slots in table order.
+template <typename Slot, typename U>
+struct HashMapNext
+{
+  Option<U> operator()()
+  {
+    if (remaining_ == 0)
+    {
+      return Option<U>();
+    }
+    while (ctrl_[index_] < 0)
+    {
+      index_++;
+    }
+    Slot& slot = slots_[index_++];
+    remaining_--;
+    return Option<U>(U(&slot.key, &slot.value));
+  }
+
+  usize len() const
+  {
+    return remaining_;
+  }
+
+  SizeHint size_hint() const
+  {
+    return exact_size_hint(remaining_);
+  }
+
+  const i8* ctrl_;
+  Slot* slots_;
+  usize index_;
+  usize remaining_;
+};
+
+/// A hash map with open addressing in the style of SwissTable. Keys and values live in one flat
+/// array of slots, next to an array with a control byte per slot. A lookup loads a group of control
+/// bytes at once and only compares the keys of slots whose control byte matches 7 bits of the hash,
+/// so a miss rarely touches a slot. Inserting invalidates references into the map, like Vec.
+template <typename K, typename V, typename Hash = std::hash<K>, typename Eq = std::equal_to<K>>
+struct HashMap
+{
+  struct Slot
+  {
+    K key;
+    V value;
+  };
+
+  /// A slot for a key, either holding it already or where it will be inserted, see entry().
+  struct Entry
+  {
+    bool is_occupied() const
+    {
+      return occupied_;
+    }
+
+    const K& key() const
+    {
+      return occupied_ ? map_->slots_[index_].key : key_;
+    }
+
+    /// Call f on the value if the key is present.
+    template <typename F>
+    Entry and_modify(F&& f) &&
+    {
+      if (occupied_)
+      {
+        f(map_->slots_[index_].value);
+      }
+      return std::move(*this);
+    }
+
+    V& or_insert(V v) &&
+    {
+      return std::move(*this).or_insert_with([&v]() { return std::move(v); });
+    }
+
+    V& or_default() &&
+    {
+      return std::move(*this).or_insert_with([]() { return V{}; });
+    }
+
+    /// The value of the key, inserting the result of f() first if the key is absent.
+    template <typename F>
+    V& or_insert_with(F&& f) &&
+    {
+      if (!occupied_)
+      {
+        index_ = map_->emplace_new(hash_, std::move(key_), f());
+        occupied_ = true;
+      }
+      return map_->slots_[index_].value;
+    }
+
+  private:
+    friend struct HashMap;
+    Entry(HashMap* map, K key, u64 hash, usize index, bool occupied)
+      : map_(map), key_(std::move(key)), hash_(hash), index_(index), occupied_(occupied)
+    {
+    }
+
+    HashMap* map_;
+    K key_;
+    u64 hash_;
+    usize index_;
+    bool occupied_;
+  };
+
+  HashMap() = default;
+
+  HashMap(std::initializer_list<std::pair<K, V>> v)
+  {
+    reserve(v.size());
+    for (const auto& [key, value] : v)
+    {
+      insert(key, value);
+    }
+  }
+
+  HashMap(const HashMap& o) : hash_(o.hash_), eq_(o.eq_)
+  {
+    reserve(o.len_);
+    o.for_each_slot([this](const Slot& slot) { emplace_new(hash_of(slot.key), slot.key, slot.value); });
+  }
+
+  HashMap(HashMap&& o) noexcept
+    : ctrl_(std::exchange(o.ctrl_, nullptr))
+    , slots_(std::exchange(o.slots_, nullptr))
+    , capacity_(std::exchange(o.capacity_, 0))
+    , len_(std::exchange(o.len_, 0))
+    , growth_left_(std::exchange(o.growth_left_, 0))
+    , hash_(std::move(o.hash_))
+    , eq_(std::move(o.eq_))
+  {
+  }
+
+  HashMap& operator=(HashMap o) noexcept
+  {
+    std::swap(ctrl_, o.ctrl_);
+    std::swap(slots_, o.slots_);
+    std::swap(capacity_, o.capacity_);
+    std::swap(len_, o.len_);
+    std::swap(growth_left_, o.growth_left_);
+    std::swap(hash_, o.hash_);
+    std::swap(eq_, o.eq_);
+    return *this;
+  }
+
+  ~HashMap()
+  {
+    release();
+  }
+
+  /// An empty map that holds n entries before it allocates again.
+  static HashMap with_capacity(usize n)
+  {
+    HashMap m;
+    m.reserve(n);
+    return m;
+  }
+
+  usize len() const
+  {
+    return len_;
+  }
+
+  bool is_empty() const
+  {
+    return len_ == 0;
+  }
+
+  /// The number of entries the map holds before it grows.
+  usize capacity() const
+  {
+    return len_ + growth_left_;
+  }
+
+  void reserve(usize additional)
+  {
+    if (additional > growth_left_)
+    {
+      rehash(table_size_for(len_ + additional));
+    }
+  }
+
+  /// Insert or overwrite the value of key, returning the value it replaced.
+  Option<V> insert(K key, V value)
+  {
+    const u64 hash = hash_of(key);
+    const usize found = find(hash, key);
+    if (found != capacity_)
+    {
+      V& slot = slots_[found].value;
+      Option<V> old(std::move(slot));
+      slot = std::move(value);
+      return old;
+    }
+    emplace_new(hash, std::move(key), std::move(value));
+    return Option<V>();
+  }
+
+  Option<Ref<V>> get(const K& key) const
+  {
+    const usize found = find(hash_of(key), key);
+    return found != capacity_ ? Option<Ref<V>>(Ref<V>(&slots_[found].value)) : Option<Ref<V>>();
+  }
+
+  Option<RefMut<V>> get_mut(const K& key)
+  {
+    const usize found = find(hash_of(key), key);
+    return found != capacity_ ? Option<RefMut<V>>(RefMut<V>(&slots_[found].value)) : Option<RefMut<V>>();
+  }
+
+  bool contains_key(const K& key) const
+  {
+    return find(hash_of(key), key) != capacity_;
+  }
+
+  /// Remove key, returning its value. The slot becomes a tombstone that is reused by inserts.
+  Option<V> remove(const K& key)
+  {
+    const usize found = find(hash_of(key), key);
+    if (found == capacity_)
+    {
+      return Option<V>();
+    }
+    Slot& slot = slots_[found];
+    Option<V> v(std::move(slot.value));
+    std::destroy_at(&slot);
+    set_ctrl(found, HashGroup::deleted);
+    len_--;
+    return v;
+  }
+
+  /// The entry for key, for in place updates such as map.entry(k).or_insert(0) += v.
+  Entry entry(K key)
+  {
+    const u64 hash = hash_of(key);
+    const usize found = find(hash, key);
+    return Entry(this, std::move(key), hash, found, found != capacity_);
+  }
+
+  void clear()
+  {
+    for_each_slot([](Slot& slot) { std::destroy_at(&slot); });
+    if (capacity_ != 0)
+    {
+      std::memset(ctrl_, HashGroup::empty, capacity_ + HashGroup::width);
+    }
+    len_ = 0;
+    growth_left_ = max_load(capacity_);
+  }
+
+  /// Insert the (key, value) tuples of an iterator or container, later values overwrite earlier ones.
+  template <typename It>
+  void extend(It&& it)
+  {
+    if constexpr (HasNext<std::remove_cvref_t<It>>)
+    {
+      reserve(reserve_hint(it));
+      std::move(it).for_each(
+          [this](auto&& kv)
+          {
+            insert(deref(std::move(tuple_part<0>(kv))), deref(std::move(tuple_part<1>(kv))));
+          });
+    }
+    else
+    {
+      extend(into_iter(it));
+    }
+  }
+
+  /// The entries as Tuple<Ref<K>, Ref<V>>, in no particular order.
+  auto iter() const
+  {
+    using U = Tuple<Ref<K>, Ref<V>>;
+    return make_iterator<U>(HashMapNext<const Slot, U>{ ctrl_, slots_, 0, len_ }, len_);
+  }
+
+  /// The entries as Tuple<Ref<K>, RefMut<V>>, in no particular order.
+  auto iter_mut()
+  {
+    using U = Tuple<Ref<K>, RefMut<V>>;
+    return make_iterator<U>(HashMapNext<Slot, U>{ ctrl_, slots_, 0, len_ }, len_);
+  }
+
+  auto keys() const
+  {
+    return iter().map([](const auto& kv) { return kv.template get<0>(); });
+  }
+
+  auto values() const
+  {
+    return iter().map([](const auto& kv) { return kv.template get<1>(); });
+  }
+
+private:
+  // Tables are at least one group large, such that a group load never needs to wrap around twice.
+  static usize table_size_for(usize n)
+  {
+    return std::bit_ceil(std::max<usize>(HashGroup::width, n + (n + 6) / 7));
+  }
+
+  // At most 7/8 of the slots are in use, which keeps probe sequences short.
+  static usize max_load(usize capacity)
+  {
+    return capacity - capacity / 8;
+  }
+
+  // The top bits select the first group, the low 7 bits are stored in the control byte. Hashes
+  // like std::hash<int> are the identity, so they are mixed first.
+  u64 hash_of(const K& key) const
+  {
+    u64 h = static_cast<u64>(hash_(key));
+    h ^= h >> 32;
+    h *= 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 29);
+  }
+
+  static i8 h2(u64 hash)
+  {
+    return static_cast<i8>(hash & 0x7F);
+  }
+
+  // The slot holding key, or capacity_ if it is absent.
+  usize find(u64 hash, const K& key) const
+  {
+    if (capacity_ == 0)
+    {
+      return capacity_;
+    }
+    const usize mask = capacity_ - 1;
+    usize pos = (hash >> 7) & mask;
+    for (usize stride = HashGroup::width;; stride += HashGroup::width)
+    {
+      const HashGroup group(ctrl_ + pos);
+      for (auto m = group.match(h2(hash)); m != 0; m &= m - 1)
+      {
+        const usize index = (pos + HashGroup::index(m)) & mask;
+        if (eq_(slots_[index].key, key))
+        {
+          return index;
+        }
+      }
+      if (group.match_empty() != 0)
+      {
+        return capacity_;
+      }
+      pos = (pos + stride) & mask;
+    }
+  }
+
+  // The first empty or deleted slot on the probe sequence of hash, the table must have one.
+  usize find_free(u64 hash) const
+  {
+    const usize mask = capacity_ - 1;
+    usize pos = (hash >> 7) & mask;
+    for (usize stride = HashGroup::width;; stride += HashGroup::width)
+    {
+      const auto m = HashGroup(ctrl_ + pos).match_free();
+      if (m != 0)
+      {
+        return (pos + HashGroup::index(m)) & mask;
+      }
+      pos = (pos + stride) & mask;
+    }
+  }
+
+  // Insert a key known to be absent, returning its slot.
+  template <typename KeyArg, typename ValueArg>
+  usize emplace_new(u64 hash, KeyArg&& key, ValueArg&& value)
+  {
+    usize index = capacity_ == 0 ? 0 : find_free(hash);
+    if (capacity_ == 0 || (growth_left_ == 0 && ctrl_[index] == HashGroup::empty))
+    {
+      // Grow, or only clean out the tombstones if they are what fills the table.
+      rehash(capacity_ == 0 ? HashGroup::width : len_ * 2 < max_load(capacity_) ? capacity_ : 2 * capacity_);
+      index = find_free(hash);
+    }
+    std::construct_at(&slots_[index], std::forward<KeyArg>(key), std::forward<ValueArg>(value));
+    growth_left_ -= ctrl_[index] == HashGroup::empty;
+    set_ctrl(index, h2(hash));
+    len_++;
+    return index;
+  }
+
+  // Groups near the end of the table read past it, into a copy of the first group.
+  void set_ctrl(usize index, i8 c)
+  {
+    ctrl_[index] = c;
+    if (index < HashGroup::width)
+    {
+      ctrl_[capacity_ + index] = c;
+    }
+  }
+
+  template <typename F>
+  void for_each_slot(F&& f) const
+  {
+    for (usize i = 0; i < capacity_; i++)
+    {
+      if (ctrl_[i] >= 0)
+      {
+        f(slots_[i]);
+      }
+    }
+  }
+
+  // Move every entry into a fresh table with capacity slots, which also drops the tombstones.
+  void rehash(usize capacity)
+  {
+    HashMap fresh;
+    fresh.hash_ = hash_;
+    fresh.eq_ = eq_;
+    fresh.allocate(capacity);
+    for_each_slot(
+        [&fresh](Slot& slot)
+        {
+          const u64 hash = fresh.hash_of(slot.key);
+          const usize index = fresh.find_free(hash);
+          std::construct_at(&fresh.slots_[index], std::move(slot));
+          fresh.set_ctrl(index, h2(hash));
+        });
+    fresh.len_ = len_;
+    fresh.growth_left_ = max_load(capacity) - len_;
+    *this = std::move(fresh);
+  }
+
+  void allocate(usize capacity)
+  {
+    ctrl_ = std::allocator<i8>().allocate(capacity + HashGroup::width);
+    slots_ = std::allocator<Slot>().allocate(capacity);
+    capacity_ = capacity;
+    std::memset(ctrl_, HashGroup::empty, capacity + HashGroup::width);
+    growth_left_ = max_load(capacity);
+  }
+
+  void release()
+  {
+    if (capacity_ == 0)
+    {
+      return;
+    }
+    for_each_slot([](Slot& slot) { std::destroy_at(&slot); });
+    std::allocator<i8>().deallocate(ctrl_, capacity_ + HashGroup::width);
+    std::allocator<Slot>().deallocate(slots_, capacity_);
+    capacity_ = 0;
+  }
+
+  i8* ctrl_{ nullptr };
+  Slot* slots_{ nullptr };
+  usize capacity_{ 0 };
+  usize len_{ 0 };
+  usize growth_left_{ 0 };
+  [[no_unique_address]] Hash hash_{};
+  [[no_unique_address]] Eq eq_{};
+};
+
+}  // namespace detail
+
+template <typename... T>
+using Tuple = detail::Tuple<T...>;
+
+template <typename T>
+using Option = detail::Option<T>;
+
+template <typename T, typename E>
+using Result = detail::Result<T, E>;
+
+template <typename T>
+using Slice = detail::Slice<T>;
+
+template <typename T, typename Alloc = std::allocator<T>>
+using Vec = detail::Vec<T, Alloc>;
+
+template <typename T, usize N>
+using ArrayVec = detail::ArrayVec<T, N>;
+
+template <typename T, usize N>
+using SmallVec = detail::SmallVec<T, N>;
+
+template <typename K, typename V, typename Hash = std::hash<K>, typename Eq = std::equal_to<K>>
+using HashMap = detail::HashMap<K, V, Hash, Eq>;
+
+/// The adapter types, such that pipelines can be named, stored in structs and returned from functions.
+template <typename Upstream, typename F>
+using Map = detail::Iterator<detail::TypeOrUnit<std::invoke_result_t<F&, typename Upstream::type>>,
+                             detail::MapNext<Upstream, F>>;
+
+template <typename Upstream>
+using Enumerate = detail::Iterator<std::tuple<usize, typename Upstream::type>, detail::EnumerateNext<Upstream>>;
+
+template <typename Left, typename Right>
+using Zip = detail::Iterator<Tuple<typename Left::type, typename Right::type>, detail::ZipNext<Left, Right>>;
+
+template <typename Upstream>
+using Skip = detail::Iterator<typename Upstream::type, detail::SkipNext<Upstream>>;
+
+template <typename Upstream>
+using Take = detail::Iterator<typename Upstream::type, detail::TakeNext<Upstream>>;
+
+template <typename Upstream>
+using StepBy = detail::Iterator<typename Upstream::type, detail::StepByNext<Upstream>>;
+
+template <typename Upstream, typename P>
+using Filter = detail::Iterator<typename Upstream::type, detail::FilterNext<Upstream, P>>;
+
+template <typename Upstream, typename F>
+using FilterMap = detail::Iterator<typename detail::FilterMapNext<Upstream, F>::U, detail::FilterMapNext<Upstream, F>>;
+
+template <typename Upstream, typename P>
+using TakeWhile = detail::Iterator<typename Upstream::type, detail::TakeWhileNext<Upstream, P>>;
+
+template <typename Upstream, typename P>
+using SkipWhile = detail::Iterator<typename Upstream::type, detail::SkipWhileNext<Upstream, P>>;
+
+template <typename Upstream, typename F>
+using MapWhile = detail::Iterator<typename detail::MapWhileNext<Upstream, F>::U, detail::MapWhileNext<Upstream, F>>;
+
+template <typename Upstream, typename St, typename F>
+using Scan = detail::Iterator<typename detail::ScanNext<Upstream, St, F>::U, detail::ScanNext<Upstream, St, F>>;
+
+template <typename Upstream>
+using Flatten = detail::Iterator<typename detail::FlattenNext<Upstream>::U, detail::FlattenNext<Upstream>>;
+
+template <typename Upstream, typename F>
+using FlatMap = Flatten<Map<Upstream, F>>;
+
+template <typename Upstream>
+using Fuse = detail::Iterator<typename Upstream::type, detail::FuseNext<Upstream>>;
+
+template <typename Upstream>
+using Rev = detail::Iterator<typename Upstream::type, detail::RevNext<Upstream>>;
+
+template <typename Upstream>
+using ByRef = detail::Iterator<typename Upstream::type, detail::ByRefNext<Upstream>>;
+
+template <typename C>
+auto slice(C& container) requires rust::DataSize<C>
+{
+  using SliceType = std::conditional_t<std::is_const_v<C>, const typename C::value_type, typename C::value_type>;
+  return detail::Slice<SliceType>::from_raw_parts(container.data(), container.size());
+}
+
+template <typename C>
+auto slice(const C& container) requires Borrowable<C>
+{
+  return Borrow<C>::borrow(container);
+}
+
+template <DataSize A>
+struct IntoIterator<A>
+{
+  static auto into_iter(const A& c)
+  {
+    return slice(c).iter();
+  }
+};
+
+template <typename C>
+auto iter(const C& container)
+{
+  auto start = container.cbegin();
+  auto end = container.cend();
+  const auto size = container.size();
+  return detail::make_iterator<Ref<typename C::value_type>>(start, end, size);
+}
+
+template <typename C>
+auto iter_mut(C& container)
+{
+  auto start = container.begin();
+  auto end = container.end();
+  const auto size = container.size();
+  return detail::make_iterator<RefMut<typename C::value_type>>(start, end, size);
+}
+
+namespace detail
+{
+/// Next function for drain(), moves the values out of the container it holds.
+template <typename C>
+struct DrainNext
+{
+  using value_type = typename C::value_type;
+
+  DrainNext(C container, usize remaining) : container_(std::move(container)), remaining_(remaining)
+  {
+  }
+
+  // Copies and moves take the positions in the other container and apply them to our own, the
+  // other's iterators would point into a container that is not ours, or no longer alive.
+  DrainNext(const DrainNext& o) : DrainNext(o.container_, o.remaining_, o.offsets())
+  {
+  }
+
+  DrainNext(DrainNext&& o) noexcept(std::is_nothrow_move_constructible_v<C>)
+    : DrainNext(std::move(o.container_), o.remaining_, o.offsets())
+  {
+  }
+
+  DrainNext& operator=(const DrainNext&) = delete;
+  DrainNext& operator=(DrainNext&&) = delete;
+
+  Option<value_type> operator()()
+  {
+    init();
+    auto& start_it = start_.as_mut().unwrap().deref();
+    auto& end_it = end_.as_mut().unwrap().deref();
+    if (start_it != end_it)
+    {
+      auto v = std::move(*start_it);
+      auto res = Option<value_type>(std::move(v));
+      start_it++;
+      remaining_--;
+      return res;
+    }
+    else
+    {
+      return Option<value_type>();
+    }
+  }
+
+  Option<value_type> next_back() requires std::bidirectional_iterator<typename C::iterator>
+  {
+    init();
+    auto& start_it = start_.as_mut().unwrap().deref();
+    auto& end_it = end_.as_mut().unwrap().deref();
+    if (start_it != end_it)
+    {
+      end_it--;
+      remaining_--;
+      return Option<value_type>(std::move(*end_it));
+    }
+    return Option<value_type>();
+  }
+
+  template <typename Acc, typename G>
+  Acc fold(Acc acc, G& g)
+  {
+    init();
+    auto& start_it = start_.as_mut().unwrap().deref();
+    const auto end_it = end_.as_ref().unwrap().deref();
+    for (; start_it != end_it; ++start_it)
+    {
+      acc = g(std::move(acc), std::move(*start_it));
+    }
+    remaining_ = 0;
+    return acc;
+  }
+
+  // The iterators are taken on first use, such that they refer to our own copy of the container.
+  void init()
+  {
+    if (!start_.is_some())
+    {
+      start_ = Option<typename C::iterator>(container_.begin());
+    }
+    if (!end_.is_some())
+    {
+      end_ = Option<typename C::iterator>(container_.end());
+    }
+  }
+
+  usize len() const
+  {
+    return remaining_;
+  }
+
+  SizeHint size_hint() const
+  {
+    return exact_size_hint(remaining_);
+  }
+
+  C container_;
+  usize remaining_;
+  Option<typename C::iterator> start_{};
+  Option<typename C::iterator> end_{};
+
+private:
+  using Offsets = Option<std::pair<usize, usize>>;
+
+  // The container is taken by reference, such that the offsets are computed before it is moved.
+  template <typename Container>
+  DrainNext(Container&& container, usize remaining, Offsets offsets)
+    : container_(std::forward<Container>(container)), remaining_(remaining)
+  {
+    if (std::pair<usize, usize> o; offsets.Some(o))
+    {
+      start_ = Option<typename C::iterator>(std::next(container_.begin(), o.first));
+      end_ = Option<typename C::iterator>(std::next(container_.begin(), o.second));
+    }
+  }
+
+  Offsets offsets() const
+  {
+    if (!start_.is_some())
+    {
+      return Offsets();
+    }
+    using ConstIt = typename C::const_iterator;
+    const ConstIt begin = container_.begin();
+    const auto offset = [&](const Option<typename C::iterator>& it)
+    { return static_cast<usize>(std::distance(begin, ConstIt(it.as_ref().unwrap().deref()))); };
+    return Offsets(std::pair<usize, usize>(offset(start_), offset(end_)));
+  }
+};
+}  // namespace detail
+
+/// Iterate over the values of a container by value. A container passed as an rvalue is moved into
+/// the iterator, an lvalue one is copied first.
+template <typename C>
+auto drain(C&& container)
+{
+  using Container = std::remove_cvref_t<C>;
+  const auto size = container.size();
+  return detail::make_iterator<typename Container::value_type>(
+      detail::DrainNext<Container>{ std::forward<C>(container), size }, size);
+}
+
+template <class T>
+concept ConstCharString = std::is_same_v < std::remove_cvref_t<T>,
+const char* > ;
+
+template <ConstCharString T>
+struct Borrow<T>
+{
+  using type = const char;
+  static detail::Slice<const char> borrow(const char* s)
+  {
+    return detail::Slice<const char>::from_raw_parts(s, std::strlen(s));
+  }
+};
+
+/// A null terminated string that measures its length once, with strlen. It borrows as a
+/// Slice<const char> without scanning the string again, so it can be kept around as a needle.
+class CStr
+{
+public:
+  explicit CStr(const char* s) : ptr_(s), len_(s == nullptr ? 0 : std::strlen(s))
+  {
+    if (s == nullptr)
+    {
+      throw panic_error("CStr from a null pointer");
+    }
+  }
+
+  /// The pointer to the first character, the string is null terminated.
+  const char* as_ptr() const
+  {
+    return ptr_;
+  }
+
+  /// The number of characters, without the null terminator.
+  usize len() const
+  {
+    return len_;
+  }
+
+  bool is_empty() const
+  {
+    return len_ == 0;
+  }
+
+  Slice<const char> as_slice() const
+  {
+    return Slice<const char>::from_raw_parts(ptr_, len_);
+  }
+
+  operator Slice<const char>() const
+  {
+    return as_slice();
+  }
+
+private:
+  const char* ptr_;
+  usize len_;
+};
+
+template <>
+struct Borrow<CStr>
+{
+  using type = const char;
+  static Slice<const char> borrow(const CStr& s)
+  {
+    return s.as_slice();
+  }
+};
+
+template <rust::DataSize T>
+struct Borrow<T>
+{
+  using type = const typename std::remove_cvref_t<T>::value_type;
+  static detail::Slice<type> borrow(const T& s)
+  {
+    return detail::Slice<type>::from_raw_parts(s.data(), s.size());
+  }
+};
+
+template <typename T>
+struct Borrow<rust::Slice<T>>
+{
+  using type = const T;
+  static rust::Slice<type> borrow(const rust::Slice<T>& s)
+  {
+    return detail::Slice<type>::from_raw_parts(s.as_ptr(), s.len());
+    ;
+  }
+};
+
+template <typename T>
+concept IsArray = std::is_array_v<std::remove_cvref_t<T>>;
+
+template <IsArray T>
+struct Borrow<T>
+{
+  using type = const std::remove_extent_t<std::remove_cvref_t<T>>;
+  static constexpr std::size_t N = std::extent_v<std::remove_cvref_t<T>>;
+
+  // For char[N], we pop the null byte at the end.
+  static rust::Slice<type> borrow(const type* s) requires std::is_same<type, const char>::value
+  {
+    return detail::Slice<type>::from_raw_parts(s, N - 1);
+  }
+  static rust::Slice<type> borrow(const type* s) requires(!std::is_same<type, const char>::value)
+  {
+    return detail::Slice<type>::from_raw_parts(s, N);
+  }
+};
+
+template <typename A, typename Alloc>
+struct FromIterator<Vec<A, Alloc>>
+{
+  template <typename It>
+  static Vec<A, Alloc> from_iter(It&& it)
+  {
+    std::vector<A, Alloc> c = FromIterator<std::vector<A, Alloc>>::from_iter(it);
+    return Vec<A, Alloc>(std::move(c));
+  }
+};
+
+template <typename A, typename Alloc>
+struct Extend<Vec<A, Alloc>>
+{
+  template <typename It>
+  static void extend(Vec<A, Alloc>& c, It&& it)
+  {
+    c.extend(std::forward<It>(it));
+  }
+};
+
+template <typename A, usize N>
+struct Extend<ArrayVec<A, N>>
+{
+  template <typename It>
+  static void extend(ArrayVec<A, N>& c, It&& it)
+  {
+    c.extend(std::forward<It>(it));
+  }
+};
+
+template <typename A, usize N>
+struct Extend<SmallVec<A, N>>
+{
+  template <typename It>
+  static void extend(SmallVec<A, N>& c, It&& it)
+  {
+    c.extend(std::forward<It>(it));
+  }
+};
+
+template <typename K, typename V, typename Hash, typename Eq>
+struct Extend<HashMap<K, V, Hash, Eq>>
+{
+  template <typename It>
+  static void extend(HashMap<K, V, Hash, Eq>& c, It&& it)
+  {
+    c.extend(std::forward<It>(it));
+  }
+};
+
+/// Collecting into an ArrayVec panics when the iterator yields more than N values, use take(N)
+/// first to truncate instead.
+template <typename A, usize N>
+struct FromIterator<ArrayVec<A, N>>
+{
+  template <typename It>
+  static ArrayVec<A, N> from_iter(It&& it)
+  {
+    ArrayVec<A, N> v;
+    v.extend(std::forward<It>(it));
+    return v;
+  }
+};
+
+template <typename K, typename V, typename Hash, typename Eq>
+struct FromIterator<HashMap<K, V, Hash, Eq>>
+{
+  template <typename It>
+  static HashMap<K, V, Hash, Eq> from_iter(It&& it)
+  {
+    HashMap<K, V, Hash, Eq> m;
+    m.extend(std::forward<It>(it));
+    return m;
+  }
+};
+
+template <typename A, usize N>
+struct FromIterator<SmallVec<A, N>>
+{
+  template <typename It>
+  static SmallVec<A, N> from_iter(It&& it)
+  {
+    SmallVec<A, N> v;
+    v.extend(std::forward<It>(it));
+    return v;
+  }
+};
+
+/// Binary encoding. Values are written in native byte order, each starting at a multiple of its
+/// alignment counted from the start of the buffer, such that a decoder over a suitably aligned
+/// buffer (any heap allocation or mapping) can hand out slices that alias the bytes.
+///
+/// - Trivially copyable values: their bytes. Records with pointer members must not be encoded,
+///   the addresses would be written and not what they point to.
+/// - bool: a u8 that is 0 or 1.
+/// - Slice, Vec, std::vector, std::string, std::string_view and std::span: the length as a u64,
+///   then the elements; one block for trivially copyable elements, otherwise each element encoded
+///   in turn.
+/// - Option: a u8 that is 1 if a value follows.
+/// - Tuple: the elements in order.
+template <typename T>
+struct Serialize;
+
+/// Types that have their own encoding, even though some of them are trivially copyable.
+template <typename T>
+struct EncodedByParts : std::false_type
+{
+};
+template <typename T>
+struct EncodedByParts<Slice<T>> : std::true_type
+{
+};
+template <typename T>
+struct EncodedByParts<Option<T>> : std::true_type
+{
+};
+template <typename... T>
+struct EncodedByParts<Tuple<T...>> : std::true_type
+{
+};
+template <typename T>
+struct EncodedByParts<Ref<T>> : std::true_type
+{
+};
+template <typename T>
+struct EncodedByParts<RefMut<T>> : std::true_type
+{
+};
+template <typename C, typename Traits>
+struct EncodedByParts<std::basic_string_view<C, Traits>> : std::true_type
+{
+};
+template <typename T, std::size_t N>
+struct EncodedByParts<std::span<T, N>> : std::true_type
+{
+};
+// Only 0 and 1 are valid bools, decoding checks the byte instead of copying it.
+template <>
+struct EncodedByParts<bool> : std::true_type
+{
+};
+
+template <typename T>
+concept BinaryPod = std::is_trivially_copyable_v<T> && !std::is_pointer_v<T> && !EncodedByParts<T>::value;
+
+/// Appends encoded values to a byte buffer.
+class Encoder
+{
+public:
+  explicit Encoder(std::vector<u8>& out) : out_(out)
   {
-    auto start = begin();
-    auto end = begin() + len();
-    using Wrapper = RefWrapper<T>;
-    return detail::make_iterator<Wrapper>(
-        [start, end]() mutable
-        {
-          if (start != end)
-          {
-            auto v = Wrapper(start);
-            start++;
-            return detail::Option(std::move(v));
-          }
-          else
-          {
-            return detail::Option<Wrapper>();
-          }
-        },
-        len());
   }
 
-  void sort() requires std::totally_ordered<T>
+  template <typename T>
+  Encoder& encode(const T& v)
   {
-    std::ranges::stable_sort(begin(), begin() + len());
+    Serialize<T>::encode(*this, v);
+    return *this;
   }
 
-  template <typename T2>
-  bool operator==(const Slice<T2>& other) const requires std::equality_comparable_with<T, T2>
+  /// Pad with zeros up to a multiple of alignment.
+  void align(usize alignment)
   {
-    if (len() != other.len())
-    {
-      return false;
-    }
-    for (usize i = 0; i < len(); i++)
-    {
-      if (!((*this)[i] == other[i]))
-      {
-        return false;
-      }
-    }
-    return true;
+    out_.resize((out_.size() + alignment - 1) / alignment * alignment);
   }
 
-  template <Borrowable BorrowableType>
-  bool starts_with(const BorrowableType& original)
-      const requires std::equality_comparable_with<T, typename Borrow<BorrowableType>::type>
+  void write(const void* p, usize n, usize alignment)
   {
-    const auto needle = Borrow<BorrowableType>::borrow(original);
-    const auto n = needle.len();
-    return len() >= n && needle == (*this)({}, n);
+    align(alignment);
+    const u8* bytes = static_cast<const u8*>(p);
+    out_.insert(out_.end(), bytes, bytes + n);
   }
 
-  const T* as_ptr() const
+  void write_len(usize n)
   {
-    return begin();
+    const u64 len = n;
+    write(&len, sizeof(len), alignof(u64));
   }
 
-protected:
-  T* begin() const
+  /// The length prefix and the elements of a sequence.
+  template <typename T>
+  void write_sequence(const T* p, usize n)
   {
-    return child_._begin();
+    if constexpr (BinaryPod<T>)
+    {
+      out_.reserve(out_.size() + sizeof(u64) + alignof(u64) + alignof(T) + n * sizeof(T));
+      write_len(n);
+      write(p, n * sizeof(T), alignof(T));
+    }
+    else
+    {
+      write_len(n);
+      for (usize i = 0; i < n; i++)
+      {
+        encode(p[i]);
+      }
+    }
   }
 
 private:
-  Child& child_;
+  std::vector<u8>& out_;
 };
 
-template <typename T>
-std::string to_string(const Slice<T>& slice)
+/// Reads encoded values from bytes, panics on input that is truncated or malformed. The bytes can
+/// be a Vec<u8>, Slice<u8>, std::vector or anything else that borrows as bytes.
+class Decoder
 {
-  std::string s = "[";
-  for (const auto& [i, v] : slice.iter().enumerate())
+public:
+  template <typename B>
+  explicit Decoder(const B& bytes)
   {
-    s += to_string(*v);
-    if (i != slice.len() - 1)
+    if constexpr (requires { bytes.as_ptr(); bytes.len(); })
     {
-      s += ", ";
+      data_ = bytes.as_ptr();
+      len_ = bytes.len();
+    }
+    else
+    {
+      const Slice<const u8> s = Borrow<B>::borrow(bytes);
+      data_ = s.as_ptr();
+      len_ = s.len();
     }
   }
-  s += "]";
-  return s;
-}
-
-/// Make an Slice printable.
-template <typename SS, typename T>
-SS& operator<<(SS& os, const Slice<T>& slice)
-{
-  os << to_string(slice);
-  return os;
-}
 
-template <typename T>
-struct Vec : SliceInterface<Vec<T>, T>
-{
-  Vec(std::initializer_list<T> v) : v_(v){};
-  Vec(const std::vector<T>& v) : v_(v){};
-  Vec(std::vector<T>&& v) : v_(v){};
+  template <typename T>
+  T decode()
+  {
+    return Serialize<T>::decode(*this);
+  }
 
-  const T* _begin() const
+  /// Whether all bytes have been decoded.
+  bool is_empty() const
   {
-    return v_.data();
+    return pos_ == len_;
   }
-  T* _begin()
+
+  /// Skip the padding up to alignment and take the next n bytes.
+  const u8* read(usize n, usize alignment)
   {
-    return v_.data();
+    const usize start = (pos_ + alignment - 1) / alignment * alignment;
+    if (start > len_ || n > len_ - start)
+    {
+      throw panic_error("binary input truncated, need " + std::to_string(n) + " bytes at offset " +
+                        std::to_string(start) + " of " + std::to_string(len_));
+    }
+    pos_ = start + n;
+    return data_ + start;
   }
-  usize _len() const
+
+  usize read_len()
   {
-    return v_.size();
+    u64 len;
+    std::memcpy(&len, read(sizeof(len), alignof(u64)), sizeof(len));
+    return static_cast<usize>(len);
   }
 
-  // We could implement the full vector interface here, but mehh, we can make our vector act
-  // like it is a std::vector by doing the following;
-  operator std::vector<T>&()
+  /// The elements of a sequence of trivially copyable values, in place.
+  template <BinaryPod T>
+  Slice<const T> read_slice()
   {
-    return v_;
+    const usize n = read_len();
+    if (n > (len_ - pos_) / sizeof(T))
+    {
+      throw panic_error("binary input truncated, sequence of " + std::to_string(n) + " elements");
+    }
+    const u8* p = read(n * sizeof(T), alignof(T));
+    if (reinterpret_cast<std::uintptr_t>(p) % alignof(T) != 0)
+    {
+      throw panic_error("binary input is not aligned for the element type, decode into a Vec instead");
+    }
+    return Slice<const T>::from_raw_parts(reinterpret_cast<const T*>(p), n);
   }
-  operator const std::vector<T>&() const
+
+  /// The elements of a sequence, copied into c.
+  template <typename C>
+  void read_sequence(C& c)
   {
-    return v_;
+    using T = typename C::value_type;
+    if constexpr (BinaryPod<T>)
+    {
+      const usize n = read_len();
+      if (n > (len_ - pos_) / sizeof(T))
+      {
+        throw panic_error("binary input truncated, sequence of " + std::to_string(n) + " elements");
+      }
+      c.resize(n);
+      std::memcpy(c.data(), read(n * sizeof(T), alignof(T)), n * sizeof(T));
+    }
+    else
+    {
+      const usize n = read_len();
+      // Every element takes at least a byte, which bounds the reservation for corrupt lengths.
+      c.reserve(std::min(n, len_ - pos_));
+      for (usize i = 0; i < n; i++)
+      {
+        c.push_back(decode<T>());
+      }
+    }
   }
 
 private:
-  std::vector<T> v_;
+  const u8* data_{ nullptr };
+  usize len_{ 0 };
+  usize pos_{ 0 };
 };
 
-template <typename T>
-std::string to_string(const Vec<T>& v)
+template <BinaryPod T>
+struct Serialize<T>
 {
-  std::string s = "[";
-  for (const auto& [index, value] : v.iter().enumerate())
+  static void encode(Encoder& e, const T& v)
   {
-    s += to_string(value);
-    if (index != v.len() - 1)
-    {
-      s += ", ";
-    }
+    e.write(&v, sizeof(T), alignof(T));
   }
-  s += "]";
-  return s;
-}
-
-/// Make an Slice printable.
-template <typename SS, typename T>
-SS& operator<<(SS& os, const Vec<T>& v)
-{
-  os << to_string(v);
-  return os;
-}
-
-}  // namespace detail
-
-template <typename... T>
-using Tuple = detail::Tuple<T...>;
-
-template <typename T>
-using Option = detail::Option<T>;
-
-template <typename T>
-using Slice = detail::Slice<T>;
+  static T decode(Decoder& d)
+  {
+    T v;
+    std::memcpy(&v, d.read(sizeof(T), alignof(T)), sizeof(T));
+    return v;
+  }
+};
 
+/// Slices encode like any sequence, decoding into Slice<const T> aliases the input without a copy.
 template <typename T>
-using Vec = detail::Vec<T>;
-
-template <typename C>
-auto slice(C& container) requires rust::DataSize<C>
-{
-  using SliceType = std::conditional_t<std::is_const_v<C>, const typename C::value_type, typename C::value_type>;
-  return detail::Slice<SliceType>::from_raw_parts(container.data(), container.size());
-}
-
-template <typename C>
-auto slice(const C& container) requires Borrowable<C>
+struct Serialize<Slice<T>>
 {
-  return Borrow<C>::borrow(container);
-}
-
-template <DataSize A>
-struct IntoIterator<A>
-{
-  static auto into_iter(const A& c)
+  static void encode(Encoder& e, const Slice<T>& s)
   {
-    return slice(c).iter();
+    e.write_sequence(s.as_ptr(), s.len());
+  }
+  static Slice<T> decode(Decoder& d) requires(std::is_const_v<T>&& BinaryPod<std::remove_const_t<T>>)
+  {
+    return d.read_slice<std::remove_const_t<T>>();
   }
 };
 
-template <typename C>
-auto iter(const C& container)
+template <>
+struct Serialize<bool>
 {
-  auto start = container.cbegin();
-  auto end = container.cend();
-  const auto size = container.size();
-  return detail::make_iterator<Ref<typename C::value_type>>(start, end, size);
-}
+  static void encode(Encoder& e, bool v)
+  {
+    e.encode(u8{ v });
+  }
+  static bool decode(Decoder& d)
+  {
+    const u8 byte = d.decode<u8>();
+    if (byte > 1)
+    {
+      throw panic_error("binary input has an invalid bool " + std::to_string(byte));
+    }
+    return byte == 1;
+  }
+};
 
-template <typename C>
-auto iter_mut(C& container)
+/// Views encode the values they refer to, decoding aliases the input like Slice<const T> does.
+template <typename C, typename Traits>
+struct Serialize<std::basic_string_view<C, Traits>>
 {
-  auto start = container.begin();
-  auto end = container.end();
-  const auto size = container.size();
-  return detail::make_iterator<RefMut<typename C::value_type>>(start, end, size);
-}
+  static void encode(Encoder& e, std::basic_string_view<C, Traits> s)
+  {
+    e.write_sequence(s.data(), s.size());
+  }
+  static std::basic_string_view<C, Traits> decode(Decoder& d) requires BinaryPod<C>
+  {
+    const Slice<const C> s = d.read_slice<C>();
+    return std::basic_string_view<C, Traits>(s.as_ptr(), s.len());
+  }
+};
 
-template <typename C>
-auto drain(C&& container)
+template <typename T, std::size_t N>
+struct Serialize<std::span<T, N>>
 {
-  auto start = Option<typename C::iterator>();
-  auto end = Option<typename C::iterator>();
-  const auto size = container.size();
-  auto f = [container, start, end]() mutable -> Option<typename C::value_type>
+  static void encode(Encoder& e, std::span<T, N> s)
   {
-    if (!start.is_some())
-    {
-      start = Option<typename C::iterator>(container.begin());
-    }
-    if (!end.is_some())
-    {
-      end = Option<typename C::iterator>(container.end());
-    }
-
-    auto& start_it = start.as_mut().unwrap().deref();
-    auto& end_it = end.as_mut().unwrap().deref();
-    if (start_it != end_it)
-    {
-      auto v = std::move(*start_it);
-      auto res = Option<typename C::value_type>(std::move(v));
-      start_it++;
-      return res;
-    }
-    else
+    e.write_sequence(s.data(), s.size());
+  }
+  static std::span<T, N> decode(Decoder& d) requires(std::is_const_v<T>&& BinaryPod<std::remove_const_t<T>>)
+  {
+    const Slice<T> s = d.read_slice<std::remove_const_t<T>>();
+    if (N != std::dynamic_extent && s.len() != N)
     {
-      return Option<typename C::value_type>();
+      throw panic_error("binary input has " + std::to_string(s.len()) + " elements for a span of " + std::to_string(N));
     }
-  };
-  return detail::make_iterator<typename C::value_type>(std::move(f), size);
-}
+    return std::span<T, N>(s.as_ptr(), s.len());
+  }
+};
 
-template <class T>
-concept ConstCharString = std::is_same_v < std::remove_cvref_t<T>,
-const char* > ;
+template <typename T, typename Alloc>
+struct Serialize<Vec<T, Alloc>>
+{
+  static void encode(Encoder& e, const Vec<T, Alloc>& v)
+  {
+    e.write_sequence(v.as_ptr(), v.len());
+  }
+  static Vec<T, Alloc> decode(Decoder& d)
+  {
+    std::vector<T, Alloc> v;
+    d.read_sequence(v);
+    return Vec<T, Alloc>(std::move(v));
+  }
+};
 
-template <ConstCharString T>
-struct Borrow<T>
+template <typename T, typename Alloc>
+struct Serialize<std::vector<T, Alloc>>
 {
-  using type = const char;
-  static detail::Slice<const char> borrow(const char* s)
+  static void encode(Encoder& e, const std::vector<T, Alloc>& v)
   {
-    for (usize i = 0; i < std::numeric_limits<usize>::max(); i++)
+    if constexpr (std::is_same_v<T, bool>)
     {
-      if (s[i] == 0)
+      // std::vector<bool> packs its bits and has no data().
+      e.write_len(v.size());
+      for (const bool b : v)
       {
-        return detail::Slice<const char>::from_raw_parts(s, i);
+        e.encode(b);
       }
     }
-    throw panic_error("could not find end of string for borrow");
+    else
+    {
+      e.write_sequence(v.data(), v.size());
+    }
+  }
+  static std::vector<T, Alloc> decode(Decoder& d)
+  {
+    std::vector<T, Alloc> v;
+    d.read_sequence(v);
+    return v;
   }
 };
 
-template <rust::DataSize T>
-struct Borrow<T>
+template <>
+struct Serialize<std::string>
 {
-  using type = const typename std::remove_cvref_t<T>::value_type;
-  static detail::Slice<type> borrow(const T& s)
+  static void encode(Encoder& e, const std::string& s)
   {
-    return detail::Slice<type>::from_raw_parts(s.data(), s.size());
+    e.write_sequence(s.data(), s.size());
+  }
+  static std::string decode(Decoder& d)
+  {
+    std::string s;
+    d.read_sequence(s);
+    return s;
   }
 };
 
 template <typename T>
-struct Borrow<rust::Slice<T>>
+struct Serialize<Option<T>>
 {
-  using type = const T;
-  static rust::Slice<type> borrow(const rust::Slice<T>& s)
+  static void encode(Encoder& e, const Option<T>& o)
   {
-    return detail::Slice<type>::from_raw_parts(s.as_ptr(), s.len());
-    ;
+    e.encode(u8{ o.is_some() });
+    if (o.is_some())
+    {
+      e.encode(o.as_ref().unwrap().deref());
+    }
+  }
+  static Option<T> decode(Decoder& d)
+  {
+    const u8 tag = d.decode<u8>();
+    if (tag > 1)
+    {
+      throw panic_error("binary input has an invalid Option tag " + std::to_string(tag));
+    }
+    return tag == 1 ? Option<T>(d.decode<T>()) : Option<T>();
   }
 };
 
-template <typename T>
-concept IsArray = std::is_array_v<std::remove_cvref_t<T>>;
-
-template <IsArray T>
-struct Borrow<T>
+template <typename... T>
+struct Serialize<Tuple<T...>>
 {
-  using type = const std::remove_extent_t<std::remove_cvref_t<T>>;
-  static constexpr std::size_t N = std::extent_v<std::remove_cvref_t<T>>;
-
-  // For char[N], we pop the null byte at the end.
-  static rust::Slice<type> borrow(const type* s) requires std::is_same<type, const char>::value
+  static void encode(Encoder& e, const Tuple<T...>& t)
   {
-    return detail::Slice<type>::from_raw_parts(s, N - 1);
+    [&]<usize... I>(std::index_sequence<I...>) { (e.encode(t.template get<I>()), ...); }
+    (std::index_sequence_for<T...>{});
   }
-  static rust::Slice<type> borrow(const type* s) requires(!std::is_same<type, const char>::value)
+  static Tuple<T...> decode(Decoder& d)
   {
-    return detail::Slice<type>::from_raw_parts(s, N);
+    // A braced list evaluates the elements in order.
+    return Tuple<T...>{ d.decode<T>()... };
   }
 };
 
-template <typename A>
-struct FromIterator<Vec<A>>
+/// Encode a value into a fresh buffer.
+template <typename T>
+Vec<u8> to_bytes(const T& v)
 {
-  template <typename It>
-  static Vec<A> from_iter(It&& it)
+  std::vector<u8> out;
+  Encoder(out).encode(v);
+  return Vec<u8>(std::move(out));
+}
+
+/// Decode a value that makes up all of bytes, slices in the value alias bytes.
+template <typename T, typename B>
+T from_bytes(const B& bytes)
+{
+  Decoder d(bytes);
+  T v = d.decode<T>();
+  if (!d.is_empty())
   {
-    std::vector<A> c = FromIterator<std::vector<A>>::from_iter(it);
-    return Vec<A>(std::move(c));
+    throw panic_error("binary input has trailing bytes");
   }
-};
+  return v;
+}
 
 namespace prelude
 {
 // This approximates the rust std prelude.
 
+using rust::ArrayVec;
+using rust::CStr;
+using rust::HashMap;
 using rust::Option;
+using rust::Result;
 using rust::Slice;
+using rust::SmallVec;
 using rust::Tuple;
 using rust::Unit;
 using rust::Vec;
@@ -0,0 +1,241 @@
+/*
+Copyright 2023 Ivor Wanders
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the author nor the names of contributors may be used to
+  endorse or promote products derived from this software without specific
+  prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+// Memory mapped files as slices, for POSIX systems.
+// auto map = Mmap::open("records.bin").unwrap();
+// map.as_slice<Record>() -> Slice<const Record>
+
+#include <cerrno>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "rust_cpp_iterator.hpp"
+
+namespace rust
+{
+
+/// Access pattern hints for a mapping, passed on to madvise.
+enum class Advice
+{
+  Normal,
+  Sequential,
+  Random,
+  WillNeed,
+  DontNeed,
+};
+
+/// A file mapped into memory. A mapping made with open() is read-only and shared with the file, one
+/// made with open_copy() is private, writes go to copy-on-write pages and never reach the file.
+/// The pages are loaded by the kernel on first access, so opening costs the same for any file size.
+class Mmap
+{
+public:
+  static Result<Mmap, std::error_code> open(const std::string& path)
+  {
+    return map(path, false);
+  }
+
+  static Result<Mmap, std::error_code> open_copy(const std::string& path)
+  {
+    return map(path, true);
+  }
+
+  Mmap() = default;
+  Mmap(const Mmap&) = delete;
+  Mmap& operator=(const Mmap&) = delete;
+
+  Mmap(Mmap&& o) noexcept
+    : data_(std::exchange(o.data_, nullptr)), len_(std::exchange(o.len_, 0)), writable_(o.writable_)
+  {
+  }
+
+  Mmap& operator=(Mmap&& o) noexcept
+  {
+    if (this != &o)
+    {
+      unmap();
+      data_ = std::exchange(o.data_, nullptr);
+      len_ = std::exchange(o.len_, 0);
+      writable_ = o.writable_;
+    }
+    return *this;
+  }
+
+  ~Mmap()
+  {
+    unmap();
+  }
+
+  /// The length of the mapping in bytes.
+  usize len() const
+  {
+    return len_;
+  }
+
+  bool is_empty() const
+  {
+    return len_ == 0;
+  }
+
+  /// Whether the mapping is private, such that as_mut_slice() may be used.
+  bool is_copy_on_write() const
+  {
+    return writable_;
+  }
+
+  /// The file as records of T, panics if the length is not a multiple of sizeof(T).
+  template <typename T = u8>
+  Slice<const T> as_slice() const requires std::is_trivially_copyable_v<T>
+  {
+    return Slice<const T>::from_raw_parts(records<T>(), len_ / sizeof(T));
+  }
+
+  /// The file as mutable records of T, for private mappings only. Sorting or otherwise modifying
+  /// this slice changes the pages of this process, the file stays as it is.
+  template <typename T = u8>
+  Slice<T> as_mut_slice() requires std::is_trivially_copyable_v<T>
+  {
+    if (!writable_)
+    {
+      throw panic_error("as_mut_slice on a read-only mapping, use Mmap::open_copy");
+    }
+    return Slice<T>::from_raw_parts(records<T>(), len_ / sizeof(T));
+  }
+
+  /// Tell the kernel how the mapping will be accessed, for example Sequential for a single scan
+  /// to read ahead aggressively, or Random for lookups to avoid reading pages that aren't needed.
+  Result<Unit, std::error_code> advise(Advice advice) const
+  {
+    if (len_ != 0 && ::madvise(data_, len_, to_madvise(advice)) != 0)
+    {
+      return Result<Unit, std::error_code>::Err(last_error());
+    }
+    return Result<Unit, std::error_code>::Ok(Unit{});
+  }
+
+private:
+  static Result<Mmap, std::error_code> map(const std::string& path, bool copy_on_write)
+  {
+    using R = Result<Mmap, std::error_code>;
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+      return R::Err(last_error());
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0)
+    {
+      const auto error = last_error();
+      ::close(fd);
+      return R::Err(error);
+    }
+    Mmap m;
+    m.len_ = static_cast<usize>(st.st_size);
+    m.writable_ = copy_on_write;
+    // Empty files can't be mapped, they are an empty slice instead.
+    if (m.len_ != 0)
+    {
+      const int prot = copy_on_write ? PROT_READ | PROT_WRITE : PROT_READ;
+      void* p = ::mmap(nullptr, m.len_, prot, copy_on_write ? MAP_PRIVATE : MAP_SHARED, fd, 0);
+      if (p == MAP_FAILED)
+      {
+        const auto error = last_error();
+        ::close(fd);
+        return R::Err(error);
+      }
+      m.data_ = p;
+    }
+    // The mapping keeps the file alive, the descriptor is no longer needed.
+    ::close(fd);
+    return R::Ok(std::move(m));
+  }
+
+  template <typename T>
+  T* records() const
+  {
+    if (len_ % sizeof(T) != 0)
+    {
+      throw panic_error("mapping of " + std::to_string(len_) + " bytes is not a multiple of the record size " +
+                        std::to_string(sizeof(T)));
+    }
+    // Mappings are page aligned, which satisfies the alignment of any record type.
+    return static_cast<T*>(data_);
+  }
+
+  static int to_madvise(Advice advice)
+  {
+    switch (advice)
+    {
+      case Advice::Sequential:
+        return MADV_SEQUENTIAL;
+      case Advice::Random:
+        return MADV_RANDOM;
+      case Advice::WillNeed:
+        return MADV_WILLNEED;
+      case Advice::DontNeed:
+        return MADV_DONTNEED;
+      case Advice::Normal:
+      default:
+        return MADV_NORMAL;
+    }
+  }
+
+  static std::error_code last_error()
+  {
+    return std::error_code(errno, std::system_category());
+  }
+
+  void unmap()
+  {
+    if (data_ != nullptr)
+    {
+      ::munmap(data_, len_);
+      data_ = nullptr;
+    }
+  }
+
+  void* data_{ nullptr };
+  usize len_{ 0 };
+  bool writable_{ false };
+};
+
+namespace prelude
+{
+using rust::Mmap;
+}  // namespace prelude
+
+}  // namespace rust
@@ -0,0 +1,137 @@
+/*
+Copyright 2023 Ivor Wanders
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the author nor the names of contributors may be used to
+  endorse or promote products derived from this software without specific
+  prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "rust_cpp_io.hpp"
+
+#define ASSERT_EQ(a, b)                                                                                                \
+  do                                                                                                                   \
+  {                                                                                                                    \
+    const auto a_ = a;                                                                                                 \
+    const auto b_ = b;                                                                                                 \
+    if (!(a_ == b_))                                                                                                   \
+    {                                                                                                                  \
+      std::cerr << __FILE__ << ":" << __LINE__ << " test failed: a != b (a:" << a_ << ", b:" << b_ << ")"              \
+                << std::endl;                                                                                          \
+      std::exit(1);                                                                                                    \
+    }                                                                                                                  \
+  } while (0)
+
+std::vector<std::string> owned(auto it)
+{
+  return std::move(it).map([](const auto& s) { return std::string(s.as_ptr(), s.len()); }).collect();
+}
+
+int main()
+{
+  namespace rs = rust;
+
+  {
+    std::cout << "Lines from a pipe" << std::endl;
+    int fds[2];
+    ASSERT_EQ(::pipe(fds), 0);
+    std::thread writer(
+        [fd = fds[1]]()
+        {
+          const std::string text = "first\r\nsecond\n\nthe last line has no newline";
+          // Write in small pieces, such that lines straddle reads.
+          for (std::size_t i = 0; i < text.size(); i += 5)
+          {
+            ::write(fd, text.data() + i, std::min<std::size_t>(5, text.size() - i));
+          }
+          ::close(fd);
+        });
+    rs::io::BufReader reader(fds[0], 8);
+    const auto lines = owned(reader.lines());
+    writer.join();
+    ::close(fds[0]);
+    ASSERT_EQ(lines.size(), 4);
+    ASSERT_EQ(lines[0], "first");
+    ASSERT_EQ(lines[1], "second");
+    ASSERT_EQ(lines[2], "");
+    ASSERT_EQ(lines[3], "the last line has no newline");
+    // The buffer grew to hold the longest line.
+    ASSERT_EQ(reader.capacity() >= 28, true);
+    ASSERT_EQ(!reader.error(), true);
+  }
+
+  {
+    std::cout << "Records from a file" << std::endl;
+    const auto path = (std::filesystem::temp_directory_path() / "rust_cpp_io_records.csv").string();
+    {
+      std::ofstream out(path, std::ios::trunc);
+      for (int i = 0; i < 1000; i++)
+      {
+        out << i << ",";
+      }
+    }
+    auto reader = rs::io::BufReader::open(path, 64).unwrap();
+    // Parse and sum without a string per record.
+    const auto sum = reader.split(',')
+                         .map(
+                             [](const auto& s)
+                             {
+                               int v = 0;
+                               for (const auto& c : s.iter())
+                               {
+                                 v = v * 10 + (*c - '0');
+                               }
+                               return v;
+                             })
+                         .sum();
+    ASSERT_EQ(sum, 999 * 1000 / 2);
+    ASSERT_EQ(reader.capacity(), 64);
+    ASSERT_EQ(reader.read_until(',').is_none(), true);
+
+    auto again = rs::io::BufReader::open(path).unwrap();
+    auto first = again.read_until(',');
+    ASSERT_EQ(first.is_some(), true);
+    ASSERT_EQ(std::move(first).unwrap() == rs::slice("0,"), true);
+    std::filesystem::remove(path);
+
+    auto missing = rs::io::BufReader::open("/nonexistent/rust_cpp_io.txt");
+    ASSERT_EQ(std::move(missing).unwrap_err() == std::errc::no_such_file_or_directory, true);
+  }
+
+  {
+    std::cout << "Read errors end the input" << std::endl;
+    rs::io::BufReader reader(-1);
+    ASSERT_EQ(reader.lines().count(), 0);
+    ASSERT_EQ(reader.error() == std::errc::bad_file_descriptor, true);
+  }
+
+  return 0;
+}
@@ -0,0 +1,178 @@
+/*
+Copyright 2023 Ivor Wanders
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+  list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+  this list of conditions and the following disclaimer in the documentation
+  and/or other materials provided with the distribution.
+
+* Neither the name of the author nor the names of contributors may be used to
+  endorse or promote products derived from this software without specific
+  prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "rust_cpp_mmap.hpp"
+
+#define ASSERT_EQ(a, b)                                                                                                \
+  do                                                                                                                   \
+  {                                                                                                                    \
+    const auto a_ = a;                                                                                                 \
+    const auto b_ = b;                                                                                                 \
+    if (!(a_ == b_))                                                                                                   \
+    {                                                                                                                  \
+      std::cerr << __FILE__ << ":" << __LINE__ << " test failed: a != b (a:" << a_ << ", b:" << b_ << ")"              \
+                << std::endl;                                                                                          \
+      std::exit(1);                                                                                                    \
+    }                                                                                                                  \
+  } while (0)
+
+struct Record
+{
+  rust::u32 key;
+  float value;
+};
+
+// Write values to a fresh file in the temporary directory, returning its path.
+template <typename T>
+std::string write_file(const std::string& name, const std::vector<T>& values)
+{
+  const auto path = (std::filesystem::temp_directory_path() / name).string();
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+  return path;
+}
+
+int main()
+{
+  namespace rs = rust;
+
+  {
+    std::cout << "Map a file read-only" << std::endl;
+    using namespace rust::prelude;
+    std::vector<Record> records;
+    for (u32 i = 0; i < 1000; i++)
+    {
+      records.push_back(Record{ i * 2, static_cast<float>(i) / 2 });
+    }
+    const auto path = write_file("rust_cpp_mmap_records.bin", records);
+
+    auto map = Mmap::open(path).unwrap();
+    ASSERT_EQ(map.len(), 1000 * sizeof(Record));
+    ASSERT_EQ(map.is_copy_on_write(), false);
+    ASSERT_EQ(map.advise(rs::Advice::Random).is_ok(), true);
+    const Slice<const Record> view = map.as_slice<Record>();
+    ASSERT_EQ(view.len(), 1000);
+    ASSERT_EQ(view[10].key, 20);
+    ASSERT_EQ(view.iter().map([](const auto& r) { return (*r).value; }).sum(), 249750.0f);
+    ASSERT_EQ(view(500, {}).len(), 500);
+    const auto found = view.binary_search_by_key(u32{ 1000 }, [](const Record& r) { return r.key; });
+    ASSERT_EQ(found, (rs::Result<usize, usize>::Ok(500)));
+
+    // The raw bytes are the default view.
+    const Slice<const u8> bytes = map.as_slice();
+    ASSERT_EQ(bytes.len(), map.len());
+
+    bool panicked = false;
+    try
+    {
+      map.as_slice<std::array<u8, 3>>();
+    }
+    catch (const rust::panic_error&)
+    {
+      panicked = true;
+    }
+    ASSERT_EQ(panicked, true);
+
+    panicked = false;
+    try
+    {
+      map.as_mut_slice<Record>();
+    }
+    catch (const rust::panic_error&)
+    {
+      panicked = true;
+    }
+    ASSERT_EQ(panicked, true);
+
+    // Moving the mapping keeps the slice valid, the pages don't move.
+    Mmap moved = std::move(map);
+    ASSERT_EQ(map.is_empty(), true);
+    ASSERT_EQ(moved.as_slice<Record>().as_ptr(), view.as_ptr());
+    std::filesystem::remove(path);
+  }
+
+  {
+    std::cout << "Sort a copy-on-write mapping" << std::endl;
+    using namespace rust::prelude;
+    const std::vector<u32> values{ 5, 3, 9, 1, 7 };
+    const auto path = write_file("rust_cpp_mmap_sort.bin", values);
+
+    auto map = Mmap::open_copy(path).unwrap();
+    ASSERT_EQ(map.advise(rs::Advice::Sequential).is_ok(), true);
+    Slice<u32> s = map.as_mut_slice<u32>();
+    s.sort();
+    const std::vector<u32> sorted{ 1, 3, 5, 7, 9 };
+    ASSERT_EQ(s, rs::slice(sorted));
+    ASSERT_EQ(s.starts_with(std::vector<u32>{ 1, 3 }), true);
+
+    // The file itself is unchanged.
+    auto original = Mmap::open(path).unwrap();
+    ASSERT_EQ(original.as_slice<u32>(), rs::slice(values));
+    std::filesystem::remove(path);
+  }
+
+  {
+    std::cout << "Reload a binary encoded spill" << std::endl;
+    using namespace rust::prelude;
+    const std::vector<u32> keys{ 4, 8, 15, 16, 23, 42 };
+    using Spill = rs::Tuple<Slice<const u32>, Option<f64>>;
+    const auto bytes = rs::to_bytes(Spill(rs::slice(keys), Option<f64>(0.25)));
+    const auto path = write_file("rust_cpp_mmap_spill.bin", std::vector<u8>(bytes));
+
+    // The decoded slice points into the mapping, nothing is read or copied up front.
+    auto map = Mmap::open(path).unwrap();
+    const auto spill = rs::from_bytes<Spill>(map.as_slice());
+    ASSERT_EQ(spill.get<0>(), rs::slice(keys));
+    ASSERT_EQ(reinterpret_cast<const u8*>(spill.get<0>().as_ptr()), map.as_slice().as_ptr() + 8);
+    ASSERT_EQ(spill.get<1>(), Option<f64>(0.25));
+    std::filesystem::remove(path);
+  }
+
+  {
+    std::cout << "Mapping errors and empty files" << std::endl;
+    using namespace rust::prelude;
+    auto missing = Mmap::open("/nonexistent/rust_cpp_mmap.bin");
+    ASSERT_EQ(missing.is_err(), true);
+    ASSERT_EQ(std::move(missing).unwrap_err() == std::errc::no_such_file_or_directory, true);
+
+    const auto path = write_file("rust_cpp_mmap_empty.bin", std::vector<u32>{});
+    auto empty = Mmap::open(path).unwrap();
+    ASSERT_EQ(empty.is_empty(), true);
+    ASSERT_EQ(empty.as_slice<u32>().len(), 0);
+    ASSERT_EQ(empty.advise(rs::Advice::WillNeed).is_ok(), true);
+    std::filesystem::remove(path);
+  }
+
+  return 0;
+}
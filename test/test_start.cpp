@@ -26,9 +26,17 @@ CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
 OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
+#include <algorithm>
+#include <array>
+#include <cctype>
 #include <cmath>
 #include <compare>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include "rust_cpp_iterator.hpp"
@@ -75,6 +83,87 @@ void print_vector(const std::vector<T>& c)
     }                                                                                                                  \
   } while (0)
 
+// A user type that declares -1 as its niche, so Option<Handle> needs no flag.
+struct Handle
+{
+  int fd{ -1 };
+  bool operator==(const Handle&) const = default;
+};
+
+template <>
+struct rust::Niche<Handle>
+{
+  static Handle none()
+  {
+    return Handle{ -1 };
+  }
+  static bool is_none(const Handle& h)
+  {
+    return h.fd == -1;
+  }
+};
+
+// Pipelines have nameable types and own their upstream, so they can be returned from factories.
+const auto squared = [](const auto& v) -> int { return *v * *v; };
+using SquaredIter = rust::Map<decltype(rust::iter(std::declval<const std::vector<int>&>())), std::remove_cvref_t<decltype(squared)>>;
+SquaredIter make_squares(const std::vector<int>& v)
+{
+  return rust::iter(v).map(squared);
+}
+
+// Returns a pipeline over a local container that has already yielded its first value.
+auto make_started_upper(const std::string& s)
+{
+  auto it = rust::drain(std::string(s)).map([](char c) { return static_cast<char>(std::toupper(c)); });
+  it.next();
+  return it;
+}
+
+template <typename T>
+concept CanRadixSort = requires(rust::Slice<T> s)
+{
+  s.radix_sort();
+};
+
+// Counts copies and moves, to check Option doesn't make any it doesn't need.
+struct Counted
+{
+  static inline int copies = 0;
+  static inline int moves = 0;
+  static void clear()
+  {
+    copies = 0;
+    moves = 0;
+  }
+
+  int v{ 0 };
+  Counted(int v) : v(v){};
+  Counted(const Counted& o) : v(o.v)
+  {
+    copies++;
+  }
+  Counted(Counted&& o) : v(o.v)
+  {
+    moves++;
+  }
+  Counted& operator=(const Counted& o)
+  {
+    v = o.v;
+    copies++;
+    return *this;
+  }
+  Counted& operator=(Counted&& o)
+  {
+    v = o.v;
+    moves++;
+    return *this;
+  }
+  bool operator==(const Counted& o) const
+  {
+    return v == o.v;
+  }
+};
+
 int main(int argc, char* argv[])
 {
   namespace rs = rust;
@@ -93,6 +182,96 @@ int main(int argc, char* argv[])
     std::cout << std::endl;
   }
 
+  {
+    std::cout << "Niche optimised Option" << std::endl;
+    static_assert(sizeof(rs::Option<rs::Ref<int>>) == sizeof(rs::Ref<int>));
+    static_assert(sizeof(rs::Option<rs::RefMut<int>>) == sizeof(rs::RefMut<int>));
+    static_assert(sizeof(rs::Option<Handle>) == sizeof(Handle));
+    static_assert(sizeof(rs::Option<int>) > sizeof(int));
+
+    int x = 3;
+    auto some = rs::Option<rs::Ref<int>>(&x);
+    ASSERT_EQ(some.is_some(), true);
+    ASSERT_EQ(*std::move(some).unwrap(), 3);
+    ASSERT_EQ(some.is_none(), true);
+    ASSERT_EQ(rs::Option<rs::RefMut<int>>().is_none(), true);
+
+    // Raw pointers have no niche, a null pointer is a valid value.
+    ASSERT_EQ(rs::Option<int*>(nullptr).is_some(), true);
+    ASSERT_EQ(rs::Option<int*>(&x).is_some(), true);
+    int y = 4;
+    auto pointers = [&]() { return rs::drain(std::vector<int*>{ &x, nullptr, &y }); };
+    rs::usize seen = 0;
+    for (int* p : pointers())
+    {
+      (void)p;
+      seen++;
+    }
+    ASSERT_EQ(seen, 3);
+    ASSERT_EQ(pointers().count(), 3);
+    ASSERT_EQ(pointers().collect<std::vector<int*>>()[1] == nullptr, true);
+
+    auto h = rs::Option<Handle>(Handle{ 4 });
+    ASSERT_EQ(h == rs::Option<Handle>(Handle{ 4 }), true);
+    ASSERT_EQ(h.map([](const Handle& v) { return v.fd * 2; }), rs::Option<int>(8));
+    h = rs::Option<Handle>();
+    ASSERT_EQ(h.is_none(), true);
+
+    const std::vector<int> a{ 1, 2 };
+    auto it = rs::iter(a);
+    ASSERT_EQ(it.next().copied(), rs::Option(1));
+    ASSERT_EQ(it.next().copied(), rs::Option(2));
+    ASSERT_EQ(it.next().is_none(), true);
+  }
+
+  {
+    std::cout << "Option copies and moves" << std::endl;
+    static_assert(std::is_trivially_copyable_v<rs::Option<int>>);
+    static_assert(std::is_trivially_destructible_v<rs::Option<int>>);
+    static_assert(std::is_trivially_copyable_v<rs::Option<rs::Ref<std::string>>>);
+    static_assert(!std::is_trivially_copyable_v<rs::Option<std::string>>);
+    static_assert(!std::is_trivially_destructible_v<rs::Option<std::string>>);
+
+    const auto counts = [](int copies, int moves) {
+      const bool ok = Counted::copies == copies && Counted::moves == moves;
+      Counted::clear();
+      return ok;
+    };
+
+    Counted::clear();
+    auto a = rs::Option<Counted>(Counted{ 1 });
+    ASSERT_EQ(counts(0, 1), true);
+    const Counted c{ 2 };
+    auto b = rs::Option<Counted>(c);
+    ASSERT_EQ(counts(1, 0), true);
+    auto in_place = rs::Option<Counted>(3);
+    ASSERT_EQ(counts(0, 0), true);
+
+    auto copy = a;
+    ASSERT_EQ(counts(1, 0), true);
+    auto moved = std::move(copy);
+    ASSERT_EQ(counts(0, 1), true);
+
+    // Assigning into a populated Option assigns the value, into an empty one constructs it.
+    moved = std::move(b);
+    ASSERT_EQ(counts(0, 1), true);
+    auto empty = rs::Option<Counted>();
+    empty = std::move(in_place);
+    ASSERT_EQ(counts(0, 1), true);
+    empty = rs::Option<Counted>();
+    ASSERT_EQ(empty.is_none(), true);
+    ASSERT_EQ(counts(0, 0), true);
+
+    ASSERT_EQ(std::move(moved).unwrap().v, 2);
+    ASSERT_EQ(counts(0, 1), true);
+
+    // Strings through an Option pipeline get moved, never copied.
+    auto s = rs::Option(std::string(64, 'x'));
+    const char* data = (*s.as_ref().unwrap()).data();
+    auto t = std::move(s).and_then([](std::string v) { return rs::Option<std::string>(std::move(v)); });
+    ASSERT_EQ(std::move(t).unwrap().data(), data);
+  }
+
   {
     auto opt = rs::Option<int>();
     try
@@ -191,6 +370,305 @@ int main(int argc, char* argv[])
     ASSERT_EQ(std::move(text_length).unwrap(), 12);
   }
 
+  {
+    std::cout << "Adapters own their upstream" << std::endl;
+    const std::vector<int> a{ 1, 2, 3, 4 };
+    // Returned from a function, the source iterator lived in that frame.
+    auto squares = make_squares(a);
+    ASSERT_EQ(squares.next(), rs::Option(1));
+    ASSERT_EQ(squares.len(), 3);
+
+    // Moving a pipeline keeps it working, this used to dangle.
+    struct Holder
+    {
+      rs::Enumerate<SquaredIter> it;
+    };
+    Holder holder{ std::move(squares).enumerate() };
+    auto moved = std::move(holder.it);
+    ASSERT_EQ(std::get<1>(moved.next().unwrap()), 4);
+
+    // A started drain owns its container, moving it rebases the position into the new container.
+    auto upper = std::make_unique<decltype(make_started_upper(""))>(make_started_upper("abcd"));
+    ASSERT_EQ(upper->next(), rs::Option('B'));
+    auto moved_upper = std::move(*upper);
+    upper.reset();
+    ASSERT_EQ(moved_upper.next(), rs::Option('C'));
+    auto copied_upper = moved_upper;
+    ASSERT_EQ(copied_upper.len(), 1);
+    ASSERT_EQ(std::move(copied_upper).collect<std::string>() == "D", true);
+    ASSERT_EQ(moved_upper.next_back(), rs::Option('D'));
+    ASSERT_EQ(moved_upper.next().is_none(), true);
+    // Moves don't throw, a std::vector of pipelines moves them when it grows.
+    static_assert(std::is_nothrow_move_constructible_v<decltype(make_started_upper(""))>);
+
+    // Or handed to another thread.
+    int total = 0;
+    std::thread summer([&total, it = make_squares(a)]() mutable { total = std::move(it).sum(); });
+    summer.join();
+    ASSERT_EQ(total, 1 + 4 + 9 + 16);
+
+    static_assert(std::is_same_v<decltype(make_squares(a).zip(a)),
+                                 rs::Zip<SquaredIter, decltype(rs::into_iter(a))>>);
+
+    // by_ref borrows the iterator, the adapters on top of it advance it and leave it usable.
+    auto it = rs::iter(a);
+    ASSERT_EQ(it.by_ref().map([](const auto& v) { return *v; }).next(), rs::Option(1));
+    ASSERT_EQ(it.by_ref().copied().try_fold(0, [](int acc, int v) { return v < 3 ? rs::Option(acc + v) : rs::Option<int>(); }),
+              rs::Option<int>());
+    ASSERT_EQ(it.len(), 1);
+    ASSERT_EQ(it.by_ref().copied().sum(), 4);
+    ASSERT_EQ(it.next().is_none(), true);
+  }
+
+  {
+    std::cout << "Double ended iterators" << std::endl;
+    const std::vector<int> a{ 1, 2, 3, 4, 5 };
+    static_assert(rs::DoubleEndedIterator<decltype(rs::iter(a))>);
+
+    auto it = rs::iter(a);
+    ASSERT_EQ(it.next_back().copied(), rs::Option(5));
+    ASSERT_EQ(it.next().copied(), rs::Option(1));
+    ASSERT_EQ(it.len(), 3);
+    ASSERT_EQ(it.next_back().copied(), rs::Option(4));
+    ASSERT_EQ(it.next_back().copied(), rs::Option(3));
+    ASSERT_EQ(it.next().copied(), rs::Option(2));
+    ASSERT_EQ(it.next_back().is_none(), true);
+    ASSERT_EQ(it.next().is_none(), true);
+
+    const auto reversed = rs::iter(a).rev().copied().collect<std::vector<int>>();
+    const std::vector<int> expected_rev{ 5, 4, 3, 2, 1 };
+    ASSERT_EQ(rs::slice(reversed), rs::slice(expected_rev));
+    const auto twice = rs::iter(a).rev().rev().copied().collect<std::vector<int>>();
+    ASSERT_EQ(rs::slice(twice), rs::slice(a));
+    ASSERT_EQ(rs::iter(a).rev().len(), 5);
+
+    // Adapters pass it through, enumerate keeps the front based index.
+    auto mapped = rs::iter(a).map([](const auto& v) { return *v * 10; });
+    ASSERT_EQ(mapped.next_back(), rs::Option(50));
+    auto enumerated = rs::iter(a).enumerate().rev();
+    ASSERT_EQ(std::get<0>(enumerated.next().unwrap()), 4);
+    ASSERT_EQ(std::get<0>(enumerated.next().unwrap()), 3);
+
+    ASSERT_EQ(rs::iter(a).last().copied(), rs::Option(5));
+    ASSERT_EQ(rs::iter(a).enumerate().map([](auto v) { return std::get<0>(v); }).last(), rs::Option<rs::usize>(4));
+    const std::vector<int> none;
+    ASSERT_EQ(rs::iter(none).last().is_none(), true);
+
+    auto searched = rs::iter(a);
+    ASSERT_EQ(searched.rfind([](const auto& v) { return *v % 2 == 0; }).copied(), rs::Option(4));
+    ASSERT_EQ(searched.len(), 3);
+    ASSERT_EQ(searched.rfind([](const auto& v) { return *v > 10; }).is_none(), true);
+    ASSERT_EQ(rs::iter(a).rposition([](const auto& v) { return *v < 3; }), rs::Option<rs::usize>(1));
+    ASSERT_EQ(rs::iter(a).rposition([](const auto& v) { return *v > 5; }), rs::Option<rs::usize>());
+
+    auto drained = rs::drain(std::vector<std::string>{ "a", "b", "c" });
+    ASSERT_EQ(drained.next_back(), rs::Option<std::string>("c"));
+    ASSERT_EQ(drained.next(), rs::Option<std::string>("a"));
+    ASSERT_EQ(drained.len(), 1);
+    ASSERT_EQ(std::move(drained).rev().last(), rs::Option<std::string>("b"));
+
+    rs::Vec<int> v{ 1, 2, 3 };
+    ASSERT_EQ(v.iter().rev().next().copied(), rs::Option(3));
+  }
+
+  {
+    std::cout << "nth, skip, take and step_by" << std::endl;
+    const std::vector<int> a{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+
+    auto it = rs::iter(a);
+    ASSERT_EQ(it.nth(3).copied(), rs::Option(3));
+    ASSERT_EQ(it.advance_by(2), 0);
+    ASSERT_EQ(it.next().copied(), rs::Option(6));
+    ASSERT_EQ(it.advance_by(10), 7);
+    ASSERT_EQ(it.nth(0).is_none(), true);
+
+    const auto collect = [](auto&& it) { return std::move(it).copied().template collect<std::vector<int>>(); };
+    const std::vector<int> skipped{ 7, 8, 9 };
+    const auto skip_result = collect(rs::iter(a).skip(7));
+    ASSERT_EQ(rs::slice(skip_result), rs::slice(skipped));
+    const std::vector<int> taken{ 0, 1, 2 };
+    const auto take_result = collect(rs::iter(a).take(3));
+    ASSERT_EQ(rs::slice(take_result), rs::slice(taken));
+    const std::vector<int> stepped{ 0, 3, 6, 9 };
+    const auto step_result = collect(rs::iter(a).step_by(3));
+    ASSERT_EQ(rs::slice(step_result), rs::slice(stepped));
+    const std::vector<int> combined{ 2, 5 };
+    const auto combined_result = collect(rs::iter(a).skip(2).step_by(3).take(2));
+    ASSERT_EQ(rs::slice(combined_result), rs::slice(combined));
+
+    ASSERT_EQ(rs::iter(a).skip(4).len(), 6);
+    ASSERT_EQ(rs::iter(a).skip(40).len(), 0);
+    ASSERT_EQ(rs::iter(a).take(4).len(), 4);
+    ASSERT_EQ(rs::iter(a).step_by(3).len(), 4);
+    ASSERT_EQ(rs::iter(a).step_by(5).len(), 2);
+    ASSERT_EQ(rs::iter(a).skip(8).next_back().copied(), rs::Option(9));
+    ASSERT_EQ(rs::iter(a).take(4).copied().sum(), 0 + 1 + 2 + 3);
+    ASSERT_EQ(rs::iter(a).take(0).count(), 0);
+    ASSERT_EQ(rs::iter(a).step_by(4).copied().last(), rs::Option(8));
+
+    // take stops the upstream once it has n values, and short circuits like any try_fold.
+    auto upstream = rs::iter(a);
+    ASSERT_EQ(upstream.by_ref().take(3).count(), 3);
+    ASSERT_EQ(upstream.next().copied(), rs::Option(3));
+    auto stopped = rs::iter(a).copied().take(5);
+    ASSERT_EQ(stopped.try_fold(0, [](int acc, int v) { return v < 2 ? rs::Option(acc + v) : rs::Option<int>(); }),
+              rs::Option<int>());
+    ASSERT_EQ(stopped.next(), rs::Option(3));
+
+    // Without random access the values are walked, with the same results.
+    auto counted = 0;
+    auto mapped = rs::iter(a).map(
+        [&counted](const auto& v)
+        {
+          counted++;
+          return *v;
+        });
+    ASSERT_EQ(mapped.nth(4), rs::Option(4));
+    ASSERT_EQ(counted, 5);
+    auto sliced = rs::iter(a).step_by(4);
+    ASSERT_EQ(std::move(sliced).enumerate().map([](auto v) { return std::get<0>(v); }).last(), rs::Option<rs::usize>(2));
+
+    bool threw = false;
+    try
+    {
+      rs::iter(a).step_by(0);
+    }
+    catch (const rs::panic_error&)
+    {
+      threw = true;
+    }
+    ASSERT_EQ(threw, true);
+  }
+
+  {
+    std::cout << "Filtering adapters" << std::endl;
+    using namespace rust::literals;
+    const std::vector<int> a{ 1, 2, 3, 4, 5, 6, 7, 8 };
+    const auto collect = [](auto&& it) { return std::move(it).template collect<std::vector<int>>(); };
+    const auto is_even = [](const auto& v) { return *v % 2 == 0; };
+
+    const auto evens = collect(rs::iter(a).filter(is_even).copied());
+    const std::vector<int> expected_evens{ 2, 4, 6, 8 };
+    ASSERT_EQ(rs::slice(evens), rs::slice(expected_evens));
+    ASSERT_EQ(rs::iter(a).filter(is_even).count(), 4);
+    ASSERT_EQ(rs::iter(a).filter(is_even).next_back().copied(), rs::Option(8));
+    ASSERT_EQ(rs::iter(a).filter(is_even).size_hint()[0_i], 0);
+    ASSERT_EQ(rs::iter(a).filter(is_even).size_hint()[1_i], rs::Option<rs::usize>(8));
+
+    // Rejected values hand the accumulator on, it is never copied.
+    const auto add = [](Counted acc, int v)
+    {
+      acc.v += v;
+      return acc;
+    };
+    Counted::clear();
+    ASSERT_EQ(rs::iter(a).copied().filter([](const int& v) { return v % 2 == 0; }).fold(Counted(0), add).v, 20);
+    ASSERT_EQ(Counted::copies, 0);
+    Counted::clear();
+    ASSERT_EQ(rs::iter(a).filter_map([](const auto& v) { return *v > 6 ? rs::Option(*v) : rs::Option<int>(); }).fold(Counted(0), add).v,
+              15);
+    ASSERT_EQ(Counted::copies, 0);
+
+    const auto halves = collect(rs::iter(a).filter_map([](const auto& v) { return *v % 2 == 0 ? rs::Option(*v / 2) : rs::Option<int>(); }));
+    const std::vector<int> expected_halves{ 1, 2, 3, 4 };
+    ASSERT_EQ(rs::slice(halves), rs::slice(expected_halves));
+
+    const auto small = collect(rs::iter(a).take_while([](const auto& v) { return *v < 4; }).copied());
+    const std::vector<int> expected_small{ 1, 2, 3 };
+    ASSERT_EQ(rs::slice(small), rs::slice(expected_small));
+    auto take_while = rs::iter(a).copied().take_while([](int v) { return v < 3; });
+    ASSERT_EQ(take_while.next(), rs::Option(1));
+    ASSERT_EQ(take_while.next(), rs::Option(2));
+    ASSERT_EQ(take_while.next().is_none(), true);
+    ASSERT_EQ(take_while.size_hint()[1_i], rs::Option<rs::usize>(0));
+
+    const auto large = collect(rs::iter(a).skip_while([](const auto& v) { return *v < 6; }).copied());
+    const std::vector<int> expected_large{ 6, 7, 8 };
+    ASSERT_EQ(rs::slice(large), rs::slice(expected_large));
+    ASSERT_EQ(rs::iter(a).skip_while([](const auto& v) { return *v < 6; }).count(), 3);
+
+    const auto mapped_while = collect(rs::iter(a).map_while([](const auto& v) { return *v < 3 ? rs::Option(*v * 10) : rs::Option<int>(); }));
+    const std::vector<int> expected_mapped_while{ 10, 20 };
+    ASSERT_EQ(rs::slice(mapped_while), rs::slice(expected_mapped_while));
+
+    const auto running = collect(rs::iter(a).scan(0,
+                                                  [](int& total, const auto& v)
+                                                  {
+                                                    total += *v;
+                                                    return total < 12 ? rs::Option(total) : rs::Option<int>();
+                                                  }));
+    const std::vector<int> expected_running{ 1, 3, 6, 10 };
+    ASSERT_EQ(rs::slice(running), rs::slice(expected_running));
+
+    // A generator that yields a value again after a None, fuse stops at the None.
+    int counter = 0;
+    const auto flaky = [&counter]() { return counter++ == 1 ? rs::Option<int>() : rs::Option<int>(counter); };
+    auto unfused = rs::detail::make_iterator<int>(flaky, 0);
+    ASSERT_EQ(unfused.next(), rs::Option(1));
+    ASSERT_EQ(unfused.next().is_none(), true);
+    ASSERT_EQ(unfused.next(), rs::Option(3));
+    counter = 0;
+    auto fused = rs::detail::make_iterator<int>(flaky, 0).fuse();
+    ASSERT_EQ(fused.next(), rs::Option(1));
+    ASSERT_EQ(fused.next().is_none(), true);
+    ASSERT_EQ(fused.next().is_none(), true);
+    ASSERT_EQ(std::move(fused).count(), 0);
+  }
+
+  {
+    std::cout << "Flattening adapters" << std::endl;
+    using namespace rust::literals;
+    const std::vector<std::vector<int>> nested{ { 1, 2 }, {}, { 3 }, { 4, 5, 6 } };
+    const std::vector<int> flat{ 1, 2, 3, 4, 5, 6 };
+
+    const auto from_vectors = rs::iter(nested).flatten().copied().collect<std::vector<int>>();
+    ASSERT_EQ(rs::slice(from_vectors), rs::slice(flat));
+    ASSERT_EQ(rs::iter(nested).flatten().copied().sum(), 21);
+
+    rs::Vec<rs::Vec<int>> vecs{ rs::Vec<int>{ 1, 2 }, rs::Vec<int>{ 3, 4, 5, 6 } };
+    ASSERT_EQ(vecs.iter().flatten().count(), 6);
+    vecs.iter_mut().flatten().for_each([](auto v) { *v *= 10; });
+    ASSERT_EQ(vecs[1][3], 60);
+
+    std::vector<int> storage{ 1, 2, 3, 4, 5, 6 };
+    std::vector<rs::Slice<int>> slices{ rs::slice(storage)(0, 2), rs::slice(storage)(2, 6) };
+    ASSERT_EQ(rs::iter(slices).flatten().copied().sum(), 21);
+    // Slices yielded by value are views, chunks flatten back into the values they cover.
+    ASSERT_EQ(rs::slice(storage).chunks(4).flatten().copied().sum(), 21);
+    ASSERT_EQ(rs::slice(flat).chunks(2).flat_map([](auto chunk) { return chunk(0, 1); }).copied().sum(), 1 + 3 + 5);
+
+    // flat_map to owned containers drains them, to iterators uses those.
+    const auto repeated = rs::iter(flat)
+                              .take(3)
+                              .flat_map([](const auto& v) { return std::vector<int>(*v, *v); })
+                              .collect<std::vector<int>>();
+    const std::vector<int> expected_repeated{ 1, 2, 2, 3, 3, 3 };
+    ASSERT_EQ(rs::slice(repeated), rs::slice(expected_repeated));
+    // Owned Vecs, ArrayVecs and SmallVecs are consumed with into_iter().
+    const auto signed_values =
+        rs::iter(flat).take(3).flat_map([](const auto& v) { return rs::Vec<int>{ *v, -*v }; }).collect<std::vector<int>>();
+    const std::vector<int> expected_signed{ 1, -1, 2, -2, 3, -3 };
+    ASSERT_EQ(rs::slice(signed_values), rs::slice(expected_signed));
+    ASSERT_EQ(rs::iter(flat).flat_map([](const auto& v) { return rs::ArrayVec<int, 2>{ *v, *v }; }).sum(), 42);
+    ASSERT_EQ(rs::iter(flat).flat_map([](const auto& v) { return rs::SmallVec<int, 1>{ *v, *v, *v }; }).sum(), 63);
+    auto words = rs::SmallVec<std::string, 1>{ "a", "bc" };
+    auto moved_words = std::move(words).into_iter();
+    ASSERT_EQ(moved_words.len(), 2);
+    ASSERT_EQ(moved_words.next_back() == rs::Option(std::string("bc")), true);
+    const auto pairs = rs::iter(nested).flat_map([](const auto& v) { return rs::iter(*v).copied().take(1); }).collect<std::vector<int>>();
+    const std::vector<int> expected_pairs{ 1, 3, 4 };
+    ASSERT_EQ(rs::slice(pairs), rs::slice(expected_pairs));
+
+    auto it = rs::iter(nested).flatten().copied();
+    ASSERT_EQ(it.next(), rs::Option(1));
+    ASSERT_EQ(it.size_hint()[0_i], 1);
+    ASSERT_EQ(it.size_hint()[1_i], rs::Option<rs::usize>());
+    ASSERT_EQ(it.try_fold(0, [](int acc, int v) { return v < 4 ? rs::Option(acc + v) : rs::Option<int>(); }),
+              rs::Option<int>());
+    ASSERT_EQ(it.next(), rs::Option(5));
+    ASSERT_EQ(it.size_hint()[1_i], rs::Option<rs::usize>(1));
+  }
+
   {
     std::cout << "Check we can make a mapped iterator" << std::endl;
     const std::vector<int> a{ 1, 2, 3, 4 };
@@ -251,6 +729,153 @@ int main(int argc, char* argv[])
     std::cout << sum << std::endl;
   }
 
+  {
+    std::cout << "Check internal iteration terminators" << std::endl;
+    const std::vector<int> a{ 1, 2, 3, 4 };
+    ASSERT_EQ(rs::iter(a).fold(0, [](int acc, const auto& v) { return acc + *v; }), 10);
+    ASSERT_EQ(rs::iter(a).map([](const auto& v) { return *v * 2; }).fold(1, [](int acc, int v) { return acc * v; }),
+              2 * 4 * 6 * 8);
+    ASSERT_EQ(rs::iter(a).copied().product(), 24);
+    ASSERT_EQ(rs::iter(a).count(), 4);
+    ASSERT_EQ(rs::iter(std::vector<int>{}).copied().sum(), 0);
+    ASSERT_EQ(rs::iter(std::vector<int>{}).copied().product(), 1);
+
+    int seen = 0;
+    rs::iter(a).enumerate().for_each(
+        [&seen](const auto& v)
+        {
+          const auto& [i, x] = v;
+          ASSERT_EQ(static_cast<int>(i) + 1, *x);
+          seen++;
+        });
+    ASSERT_EQ(seen, 4);
+
+    // try_fold short circuits on the first None, and the iterator can be resumed.
+    const auto add_below_three = [](int acc, const auto& v) -> rs::Option<int>
+    {
+      if (*v >= 3)
+      {
+        return rs::Option<int>();
+      }
+      return rs::Option<int>(acc + *v);
+    };
+    auto it = rs::iter(a);
+    ASSERT_EQ(it.try_fold(0, add_below_three), rs::Option<int>());
+    ASSERT_EQ(it.next().copied(), rs::Option<int>(4));
+    ASSERT_EQ(rs::iter(std::vector<int>{ 1, 2 }).try_fold(0, add_below_three), rs::Option<int>(3));
+  }
+
+  {
+    std::cout << "Check size_hint and len propagation" << std::endl;
+    using namespace rust::literals;
+    const std::vector<int> a{ 1, 2, 3, 4 };
+    const std::vector<int> b{ 10, 20, 30 };
+    auto it = rs::iter(a);
+    ASSERT_EQ(it.len(), 4);
+    it.next();
+    ASSERT_EQ(it.len(), 3);
+    ASSERT_EQ(it.size_hint()[1_i], rs::Option<rs::usize>(3));
+
+    ASSERT_EQ(rs::iter(a).map([](const auto& v) { return *v; }).len(), 4);
+    ASSERT_EQ(rs::iter(a).enumerate().len(), 4);
+    auto zipped = rs::iter(a).zip(b);
+    ASSERT_EQ(zipped.len(), 3);
+    ASSERT_EQ(zipped.size_hint()[0_i], 3);
+    ASSERT_EQ(zipped.size_hint()[1_i], rs::Option<rs::usize>(3));
+
+    auto drained = rs::drain(std::vector<int>{ 1, 2, 3 });
+    ASSERT_EQ(drained.len(), 3);
+    drained.next();
+    ASSERT_EQ(drained.size_hint()[1_i], rs::Option<rs::usize>(2));
+
+    static_assert(rs::ExactSizeIterator<decltype(rs::iter(a).copied())>);
+    static_assert(rs::ExactSizeIterator<decltype(rs::iter(a).zip(b).enumerate())>);
+
+    // A plain generator has no idea how long it is.
+    int counter = 0;
+    auto generated = rs::detail::make_iterator<int>(
+        [&counter]() { return counter < 5 ? rs::Option<int>(counter++) : rs::Option<int>(); }, 0);
+    static_assert(!rs::ExactSizeIterator<decltype(generated)>);
+    ASSERT_EQ(generated.size_hint()[1_i], rs::Option<rs::usize>());
+
+    // Known lengths collect with a single allocation of exactly the right size.
+    auto collected = rs::iter(a).zip(b).map([](const auto& v) { return *v[0_i] + *v[1_i]; }).collect<std::vector<int>>();
+    ASSERT_EQ(collected.size(), 3);
+    ASSERT_EQ(collected.capacity(), 3);
+
+    // Unknown lengths reserve the lower bound, not the upper bound of a filter over many values.
+    std::vector<int> many(100000, 0);
+    many[500] = 1;
+    auto rare = rs::iter(many).copied().filter([](const int& v) { return v != 0; }).collect<std::vector<int>>();
+    ASSERT_EQ(rare.size(), 1);
+    ASSERT_EQ(rare.capacity() < 16, true);
+    auto inline_rare = rs::iter(many).copied().filter([](const int& v) { return v != 0; }).collect<rs::SmallVec<int, 16>>();
+    ASSERT_EQ(inline_rare.spilled(), false);
+  }
+
+  {
+    std::cout << "Check next_chunk and for_each_batch" << std::endl;
+    std::vector<int> a{ 1, 2, 3, 4, 5 };
+    auto it = rs::iter(a);
+    auto chunk = it.next_chunk<2>();
+    ASSERT_EQ(chunk.is_some(), true);
+    ASSERT_EQ(*std::move(chunk).unwrap()[1], 2);
+    ASSERT_EQ(it.len(), 3);
+    ASSERT_EQ(it.next_chunk<4>().is_none(), true);
+    ASSERT_EQ(it.next().is_none(), true);
+
+    auto mapped = rs::iter(a).map([](const auto& v) { return *v * 10; });
+    auto mapped_chunk = mapped.next_chunk<3>();
+    ASSERT_EQ(std::move(mapped_chunk).unwrap()[2], 30);
+    ASSERT_EQ(mapped.next(), rs::Option<int>(40));
+
+    for (auto& x : rs::slice(a).iter_mut().next_chunk<2>().unwrap())
+    {
+      *x += 100;
+    }
+    ASSERT_EQ(a[1], 102);
+
+    // Batches over a slice are views into the original memory.
+    std::vector<rs::usize> offsets;
+    std::vector<rs::usize> lengths;
+    rs::iter(a).for_each_batch(2,
+                               [&](auto batch)
+                               {
+                                 offsets.push_back(batch.as_ptr() - a.data());
+                                 lengths.push_back(batch.len());
+                               });
+    const std::vector<rs::usize> expected_offsets{ 0, 2, 4 };
+    const std::vector<rs::usize> expected_lengths{ 2, 2, 1 };
+    ASSERT_EQ(rs::slice(offsets), rs::slice(expected_offsets));
+    ASSERT_EQ(rs::slice(lengths), rs::slice(expected_lengths));
+
+    rs::slice(a).iter_mut().for_each_batch(4,
+                                           [](auto batch)
+                                           {
+                                             for (rs::usize i = 0; i < batch.len(); i++)
+                                             {
+                                               batch[i] = 0;
+                                             }
+                                           });
+    const std::vector<int> zeros{ 0, 0, 0, 0, 0 };
+    ASSERT_EQ(rs::slice(a), rs::slice(zeros));
+
+    // Other iterators gather into a buffer.
+    int total = 0;
+    rs::usize batches = 0;
+    rs::iter(a).map([](const auto& v) { return *v + 1; }).for_each_batch(3,
+                                                                          [&](auto batch)
+                                                                          {
+                                                                            for (auto& v : batch.iter())
+                                                                            {
+                                                                              total += *v;
+                                                                            }
+                                                                            batches++;
+                                                                          });
+    ASSERT_EQ(total, 5);
+    ASSERT_EQ(batches, 2);
+  }
+
   {
     std::cout << "Check if range based for loop works." << std::endl;
     const std::vector<int> a{ 1, 2, 3, 4 };
@@ -484,6 +1109,30 @@ int main(int argc, char* argv[])
       ASSERT_EQ(slice_hello.starts_with(hel), true);
     }
 
+    // starts_with with a CStr, measured once and reused as a needle.
+    {
+      const rs::CStr hel{ "Hel" };
+      ASSERT_EQ(hel.len(), 3);
+      ASSERT_EQ(hel.is_empty(), false);
+      ASSERT_EQ(slice_hello.starts_with(hel), true);
+      ASSERT_EQ(slice_hello.ends_with(hel), false);
+      ASSERT_EQ(rs::slice(hel).as_ptr(), hel.as_ptr());
+      const rs::Slice<const char> as_slice = hel;
+      ASSERT_EQ(as_slice.len(), 3);
+      ASSERT_EQ(rs::CStr("").is_empty(), true);
+      ASSERT_EQ(slice_hello.starts_with(rs::CStr("")), true);
+      bool threw = false;
+      try
+      {
+        rs::CStr(nullptr);
+      }
+      catch (const rs::panic_error&)
+      {
+        threw = true;
+      }
+      ASSERT_EQ(threw, true);
+    }
+
     // starts_with c array :|
     // This is problematic, because we can't see the difference between a c array of chars and a
     // string literal, they are both a fixed length char array. With a string literal it also
@@ -506,6 +1155,223 @@ int main(int argc, char* argv[])
     }
   }
 
+  {
+    std::cout << "Check slice comparison and search" << std::endl;
+    const char* line = "GET /index.html HTTP/1.1";
+    const auto s = rs::slice(line);
+    ASSERT_EQ(s.starts_with("GET "), true);
+    ASSERT_EQ(s.starts_with("POST"), false);
+    ASSERT_EQ(s.ends_with("HTTP/1.1"), true);
+    ASSERT_EQ(s.ends_with("HTTP/1.0"), false);
+    ASSERT_EQ(s.ends_with("a much longer suffix than the line itself"), false);
+    ASSERT_EQ(s.contains('/'), true);
+    ASSERT_EQ(s.contains('#'), false);
+    ASSERT_EQ(s.position('/'), rs::Option<rs::usize>(4));
+    ASSERT_EQ(s.position('#'), rs::Option<rs::usize>());
+
+    ASSERT_EQ(rs::slice("abc").cmp("abd") < 0, true);
+    ASSERT_EQ(rs::slice("abc").cmp("ab") > 0, true);
+    ASSERT_EQ(rs::slice("abc").cmp("abc") == 0, true);
+    ASSERT_EQ(rs::slice("").cmp("") == 0, true);
+
+    // Wider elements, with hits before, inside and after the vectorised blocks.
+    std::vector<rs::u32> values(200);
+    for (rs::usize i = 0; i < values.size(); i++)
+    {
+      values[i] = static_cast<rs::u32>(i * 3);
+    }
+    const auto v = rs::slice(values);
+    ASSERT_EQ(v.position(0), rs::Option<rs::usize>(0));
+    ASSERT_EQ(v.position(60), rs::Option<rs::usize>(20));
+    ASSERT_EQ(v.position(597), rs::Option<rs::usize>(199));
+    ASSERT_EQ(v.contains(1), false);
+    std::vector<rs::u32> tail{ 591, 594, 597 };
+    ASSERT_EQ(v.ends_with(tail), true);
+    ASSERT_EQ(v.starts_with(tail), false);
+
+    // Signed values must not be ordered by their bytes.
+    std::vector<int> negative{ -1, 2 };
+    std::vector<int> positive{ 1, 2 };
+    ASSERT_EQ(rs::slice(negative).cmp(positive) < 0, true);
+    std::vector<double> zeros{ 0.0, -0.0 };
+    std::vector<double> negative_zeros{ -0.0, 0.0 };
+    ASSERT_EQ(rs::slice(zeros), rs::slice(negative_zeros));
+  }
+
+  {
+    std::cout << "Check parallel iterators" << std::endl;
+    std::vector<rs::u64> a(100000);
+    for (rs::usize i = 0; i < a.size(); i++)
+    {
+      a[i] = i;
+    }
+    const auto s = rs::slice(a);
+    const rs::u64 expected_sum = (a.size() - 1) * a.size() / 2;
+    ASSERT_EQ(s.par_iter().sum(), expected_sum);
+    ASSERT_EQ(s.par_iter().map([](const auto& v) { return *v * 2; }).sum(), 2 * expected_sum);
+    ASSERT_EQ(s.par_iter().with_min_len(1).count(), a.size());
+    ASSERT_EQ(s.par_iter().any([](const auto& v) { return *v == 77777; }), true);
+    const rs::u64 missing = a.size();
+    ASSERT_EQ(s.par_iter().any([missing](const auto& v) { return *v == missing; }), false);
+    ASSERT_EQ(s.par_iter().min(), rs::Option<rs::u64>(0));
+    ASSERT_EQ(s.par_iter().map([](const auto& v) { return *v % 1000; }).max(), rs::Option<rs::u64>(999));
+    ASSERT_EQ(rs::slice(std::vector<int>{}).par_iter().max(), rs::Option<int>());
+
+    // Order is kept when collecting.
+    auto odd_squares = s.par_iter()
+                           .filter([](const auto& v) { return *v % 2 == 1; })
+                           .map([](const auto& v) { return *v * *v; })
+                           .collect<rs::Vec<rs::u64>>();
+    ASSERT_EQ(odd_squares.len(), a.size() / 2);
+    auto sequential = rs::iter(a)
+                          .map([](const auto& v) { return *v; })
+                          .collect<std::vector<rs::u64>>();
+    bool in_order = true;
+    for (rs::usize i = 0; i < odd_squares.len(); i++)
+    {
+      in_order &= odd_squares[i] == sequential[2 * i + 1] * sequential[2 * i + 1];
+    }
+    ASSERT_EQ(in_order, true);
+
+    s.par_iter_mut().for_each([](auto v) { *v = *v + 1; });
+    ASSERT_EQ(a.front(), 1);
+    ASSERT_EQ(a.back(), a.size());
+
+    // Exceptions thrown on a worker come back to the caller.
+    bool caught = false;
+    try
+    {
+      s.par_iter().for_each(
+          [](const auto& v)
+          {
+            if (*v == 5000)
+            {
+              throw rs::panic_error("found it");
+            }
+          });
+    }
+    catch (const rs::panic_error& e)
+    {
+      caught = true;
+    }
+    ASSERT_EQ(caught, true);
+
+    // Parallel iterators can nest, and can be started from several threads at once.
+    std::vector<std::thread> threads;
+    std::atomic<rs::usize> total{ 0 };
+    for (int t = 0; t < 4; t++)
+    {
+      threads.emplace_back(
+          [&]()
+          {
+            total += s.par_iter()
+                         .with_min_len(100)
+                         .map([&](const auto& v) { return *v % 10 == 0 ? s({}, 10).par_iter().count() : 0; })
+                         .sum();
+          });
+    }
+    for (auto& t : threads)
+    {
+      t.join();
+    }
+    ASSERT_EQ(total.load(), 4 * 10 * a.size() / 10);
+  }
+
+  {
+    std::cout << "Check sort variants" << std::endl;
+    std::vector<int> random(50000);
+    rs::u32 state = 12345;
+    for (auto& v : random)
+    {
+      state = state * 1664525u + 1013904223u;
+      v = static_cast<int>(state >> 8) % 2000 - 1000;  // plenty of duplicates and negatives.
+    }
+    std::vector<int> expected = random;
+    std::sort(expected.begin(), expected.end());
+    const auto check = [&](auto&& sort_fun)
+    {
+      std::vector<int> v = random;
+      auto s = rs::slice(v);
+      sort_fun(s);
+      ASSERT_EQ(s, rs::slice(expected));
+    };
+    check([](auto& s) { s.sort_unstable(); });
+    check([](auto& s) { s.sort_by([](int a, int b) { return a <=> b; }); });
+    check([](auto& s) { s.sort_unstable_by([](int a, int b) { return a <=> b; }); });
+    check([](auto& s) { s.sort_unstable_by_key([](int a) { return a; }); });
+    check([](auto& s) { s.par_sort(); });
+    check([](auto& s) { s.par_sort_unstable(); });
+    check([](auto& s) { s.radix_sort(); });
+
+    // Stability, sort by the low digit and the original order must be kept for equal keys.
+    std::vector<int> pairs{ 31, 12, 21, 42, 11, 32 };
+    rs::slice(pairs).sort_by_key([](int v) { return v % 10; });
+    std::vector<int> expected_pairs{ 31, 21, 11, 12, 42, 32 };
+    ASSERT_EQ(rs::slice(pairs), rs::slice(expected_pairs));
+
+    std::vector<std::string> words(20000);
+    for (rs::usize i = 0; i < words.size(); i++)
+    {
+      words[i] = std::to_string((i * 7919) % words.size());
+    }
+    std::vector<std::string> sorted_words = words;
+    std::stable_sort(sorted_words.begin(), sorted_words.end());
+    rs::slice(words).par_sort();
+    ASSERT_EQ(words == sorted_words, true);
+
+    std::vector<double> floats{ 3.5, -0.0, -2.25, 1e300, 0.0, -1e300, -std::numeric_limits<double>::infinity(), 0.5 };
+    rs::slice(floats).radix_sort();
+    std::vector<double> expected_floats{ -std::numeric_limits<double>::infinity(), -1e300, -2.25, -0.0, 0.0, 0.5, 3.5, 1e300 };
+    ASSERT_EQ(rs::slice(floats), rs::slice(expected_floats));
+    ASSERT_EQ(std::signbit(floats[3]), true);
+
+    std::vector<rs::u64> large{ 1ull << 63, 5, 1ull << 40, 0, 5 };
+    rs::slice(large).radix_sort();
+    std::vector<rs::u64> expected_large{ 0, 5, 5, 1ull << 40, 1ull << 63 };
+    ASSERT_EQ(rs::slice(large), rs::slice(expected_large));
+
+    // Types without a radix key of 1, 2, 4 or 8 bytes fail the constraint instead of the body.
+    static_assert(CanRadixSort<int> && (sizeof(long double) == 8 || !CanRadixSort<long double>));
+
+    // The parallel sorts work on move-only and non default constructible values, in parallel.
+    std::vector<std::unique_ptr<int>> boxes;
+    for (rs::usize i = 0; i < 20000; i++)
+    {
+      boxes.push_back(std::make_unique<int>(static_cast<int>(i)));
+    }
+    std::reverse(boxes.begin(), boxes.end());
+    rs::slice(boxes).par_sort_unstable();
+    ASSERT_EQ(std::is_sorted(boxes.begin(), boxes.end()), true);
+    ASSERT_EQ(std::all_of(boxes.begin(), boxes.end(), [](const auto& b) { return b != nullptr; }), true);
+
+    struct Key
+    {
+      explicit Key(int v) : v(v)
+      {
+      }
+      // Only the value is compared, order records the position to check stability.
+      bool operator==(const Key& o) const
+      {
+        return v == o.v;
+      }
+      auto operator<=>(const Key& o) const
+      {
+        return v <=> o.v;
+      }
+      int v;
+      int order;
+    };
+    std::vector<Key> keys;
+    for (int i = 0; i < 20000; i++)
+    {
+      keys.push_back(Key((i * 7919) % 100));
+      keys.back().order = i;
+    }
+    rs::slice(keys).par_sort();
+    const auto by_value_then_order = [](const Key& a, const Key& b) { return a.v < b.v || (a.v == b.v && a.order < b.order); };
+    ASSERT_EQ(std::is_sorted(keys.begin(), keys.end(), by_value_then_order), true);
+  }
+
   std::cout << type_string<rs::RefWrapper<int>>() << std::endl;
   std::cout << type_string<rs::RefWrapper<int&>>() << std::endl;
   std::cout << type_string<rs::RefWrapper<const int>>() << std::endl;
@@ -619,6 +1485,197 @@ int main(int argc, char* argv[])
     auto s = iter(a).map([](const auto& v) { return (*v) * 2; }).collect<std::vector<f32>>();
   }
 
+  {
+    std::cout << "Chunks and windows" << std::endl;
+    using namespace rust::literals;
+    std::vector<int> a{ 1, 2, 3, 4, 5, 6, 7 };
+    const auto s = rs::slice(a);
+    const auto lengths = [](auto&& it) { return std::move(it).map([](const auto& c) { return c.len(); }).template collect<std::vector<rs::usize>>(); };
+
+    auto chunks = s.chunks(3);
+    ASSERT_EQ(chunks.len(), 3);
+    ASSERT_EQ(chunks.next().unwrap()[0], 1);
+    ASSERT_EQ(chunks.next_back().unwrap().len(), 1);
+    ASSERT_EQ(chunks.next().unwrap()[2], 6);
+    ASSERT_EQ(chunks.next().is_none(), true);
+    const std::vector<rs::usize> chunk_lengths{ 3, 3, 1 };
+    const auto got_chunk_lengths = lengths(s.chunks(3));
+    ASSERT_EQ(rs::slice(got_chunk_lengths), rs::slice(chunk_lengths));
+    ASSERT_EQ(s.chunks(7).len(), 1);
+    ASSERT_EQ(s.chunks(3).nth(2).unwrap()[0], 7);
+
+    auto exact = s.chunks_exact(3);
+    ASSERT_EQ(exact.len(), 2);
+    ASSERT_EQ(exact.remainder().len(), 1);
+    ASSERT_EQ(exact.remainder()[0], 7);
+    int total = 0;
+    std::move(exact).for_each(
+        [&total](const auto& chunk)
+        {
+          for (rs::usize i = 0; i < 3; i++)
+          {
+            total += chunk.get_unchecked(i);
+          }
+        });
+    ASSERT_EQ(total, 1 + 2 + 3 + 4 + 5 + 6);
+    ASSERT_EQ(s.chunks_exact(3).rev().next().unwrap()[0], 4);
+    ASSERT_EQ(s.chunks_exact(8).remainder().len(), 7);
+
+    auto rchunks = s.rchunks(3);
+    ASSERT_EQ(rchunks.next().unwrap()[0], 5);
+    ASSERT_EQ(rchunks.next().unwrap()[0], 2);
+    ASSERT_EQ(rchunks.next().unwrap()[0], 1);
+    ASSERT_EQ(rchunks.next().is_none(), true);
+    ASSERT_EQ(s.rchunks(3).next_back().unwrap().len(), 1);
+
+    ASSERT_EQ(s.windows(3).len(), 5);
+    ASSERT_EQ(s.windows(8).len(), 0);
+    const auto window_sums = s.windows(3).map([](const auto& w) { return w.iter().copied().sum(); }).collect<std::vector<int>>();
+    const std::vector<int> expected_sums{ 6, 9, 12, 15, 18 };
+    ASSERT_EQ(rs::slice(window_sums), rs::slice(expected_sums));
+    ASSERT_EQ(s.windows(3).next_back().unwrap()[0], 5);
+
+    // The views share the memory of the slice.
+    s.chunks(2).next().unwrap().first_mut().unwrap().deref() = 10;
+    ASSERT_EQ(a[0], 10);
+
+    const auto [left, right] = s.split_at(2);
+    ASSERT_EQ(left.len(), 2);
+    ASSERT_EQ(right[0], 3);
+    ASSERT_EQ(s.split_at(7)[1_i].len(), 0);
+
+    bool threw = false;
+    try
+    {
+      s.chunks(0);
+    }
+    catch (const rs::panic_error&)
+    {
+      threw = true;
+    }
+    ASSERT_EQ(threw, true);
+    threw = false;
+    try
+    {
+      s.split_at(8);
+    }
+    catch (const rs::panic_error&)
+    {
+      threw = true;
+    }
+    ASSERT_EQ(threw, true);
+  }
+
+  {
+    std::cout << "Tokenizing text slices" << std::endl;
+    using namespace rust::literals;
+    const auto pieces = [](auto&& it)
+    { return std::move(it).map([](const auto& p) { return std::string(p.as_ptr(), p.len()); }).template collect<std::vector<std::string>>(); };
+    const auto joined = [](const std::vector<std::string>& v)
+    {
+      std::string s;
+      for (const auto& x : v)
+      {
+        s += "<" + x + ">";
+      }
+      return s;
+    };
+
+    const char* log = "GET\t/index.html\t\t200";
+    const auto line = rs::slice(log);
+    ASSERT_EQ(joined(pieces(line.split('\t'))), std::string("<GET></index.html><><200>"));
+    ASSERT_EQ(joined(pieces(line.split("\t\t"))), std::string("<GET\t/index.html><200>"));
+    ASSERT_EQ(joined(pieces(line.splitn(2, '\t'))), std::string("<GET></index.html\t\t200>"));
+    ASSERT_EQ(line.splitn(0, '\t').count(), 0);
+    ASSERT_EQ(joined(pieces(rs::slice("").split(','))), std::string("<>"));
+    ASSERT_EQ(joined(pieces(rs::slice("a,").split(','))), std::string("<a><>"));
+    ASSERT_EQ(joined(pieces(rs::slice("abab").split("ab"))), std::string("<><><>"));
+    ASSERT_EQ(joined(pieces(rs::slice("aab").split(std::string("ab")))), std::string("<a><>"));
+
+    // The pieces point into the original buffer, nothing was copied.
+    ASSERT_EQ(line.split('\t').nth(1).unwrap().as_ptr(), log + 4);
+
+    const auto [key, value] = rs::slice("key=value=x").split_once('=').unwrap();
+    ASSERT_EQ(std::string(key.as_ptr(), key.len()), std::string("key"));
+    ASSERT_EQ(std::string(value.as_ptr(), value.len()), std::string("value=x"));
+    ASSERT_EQ(rs::slice("key").split_once("=").is_none(), true);
+
+    ASSERT_EQ(joined(pieces(rs::slice("  a \t bc\n d  ").split_whitespace())), std::string("<a><bc><d>"));
+    ASSERT_EQ(rs::slice(" \t ").split_whitespace().count(), 0);
+
+    const auto trimmed = rs::slice(" \t padded \r\n").trim();
+    ASSERT_EQ(std::string(trimmed.as_ptr(), trimmed.len()), std::string("padded"));
+    ASSERT_EQ(rs::slice("   ").trim().len(), 0);
+    ASSERT_EQ(rs::slice(" x ").trim_start().len(), 2);
+    ASSERT_EQ(rs::slice(" x ").trim_end().len(), 2);
+
+    ASSERT_EQ(joined(pieces(rs::slice("one\r\ntwo\n\nthree\n").lines())), std::string("<one><two><><three>"));
+    ASSERT_EQ(joined(pieces(rs::slice("no newline").lines())), std::string("<no newline>"));
+    ASSERT_EQ(rs::slice("").lines().count(), 0);
+
+    // Mutable text gives mutable pieces.
+    std::string text = "a b";
+    rs::slice(text).split(' ').last().unwrap()[0] = 'c';
+    ASSERT_EQ(text, std::string("a c"));
+  }
+
+  {
+    std::cout << "Binary search on sorted slices" << std::endl;
+    using R = rs::Result<rs::usize, rs::usize>;
+    const std::vector<int> a{ 1, 3, 3, 3, 5, 8, 13 };
+    const auto s = rs::slice(a);
+    ASSERT_EQ(s.binary_search(5), R::Ok(4));
+    ASSERT_EQ(s.binary_search(3), R::Ok(1));
+    ASSERT_EQ(s.binary_search(4), R::Err(4));
+    ASSERT_EQ(s.binary_search(0), R::Err(0));
+    ASSERT_EQ(s.binary_search(20), R::Err(7));
+    ASSERT_EQ(s.lower_bound(3), 1);
+    ASSERT_EQ(s.upper_bound(3), 4);
+    ASSERT_EQ(s.partition_point([](const int& v) { return v < 8; }), 5);
+    ASSERT_EQ(s.binary_search_by([](const int& v) { return v <=> 13; }), R::Ok(6));
+    ASSERT_EQ(s.binary_search_by([](const int& v) { return v - 6; }), R::Err(5));
+
+    const std::vector<std::tuple<int, std::string>> table{ { 1, "one" }, { 4, "four" }, { 9, "nine" } };
+    ASSERT_EQ(rs::slice(table).binary_search_by_key(4, [](const auto& e) { return std::get<0>(e); }), R::Ok(1));
+    ASSERT_EQ(rs::slice(table).binary_search_by_key(5, [](const auto& e) { return std::get<0>(e); }), R::Err(2));
+
+    const std::vector<int> empty;
+    ASSERT_EQ(rs::slice(empty).binary_search(1), R::Err(0));
+    ASSERT_EQ(R::Ok(3).is_ok(), true);
+    ASSERT_EQ(R::Err(3).is_err(), true);
+    ASSERT_EQ(R::Err(3).unwrap_err(), 3);
+    ASSERT_EQ(R::Ok(3).ok(), rs::Option<rs::usize>(3));
+    ASSERT_EQ(R::Ok(3).err().is_none(), true);
+
+    // Against the standard library, for every length up to 40 and every needle around the values.
+    for (rs::usize n = 0; n < 40; n++)
+    {
+      std::vector<int> sorted;
+      for (rs::usize i = 0; i < n; i++)
+      {
+        sorted.push_back(static_cast<int>(i / 3) * 2);
+      }
+      std::vector<int> needles;
+      for (int x = -1; x <= static_cast<int>(n); x++)
+      {
+        needles.push_back(x);
+      }
+      const auto many = rs::slice(sorted).binary_search_many(needles);
+      ASSERT_EQ(many.size(), needles.size());
+      for (rs::usize i = 0; i < needles.size(); i++)
+      {
+        const int x = needles[i];
+        const auto lower = static_cast<rs::usize>(std::lower_bound(sorted.begin(), sorted.end(), x) - sorted.begin());
+        const auto upper = static_cast<rs::usize>(std::upper_bound(sorted.begin(), sorted.end(), x) - sorted.begin());
+        const auto expected = lower != upper ? R::Ok(lower) : R::Err(lower);
+        ASSERT_EQ(rs::slice(sorted).lower_bound(x), lower);
+        ASSERT_EQ(rs::slice(sorted).upper_bound(x), upper);
+        ASSERT_EQ(rs::slice(sorted).binary_search(x), expected);
+        ASSERT_EQ(many[i], expected);
+      }
+    }
+  }
+
   // Test our Vec, which implements the slice interface, not too sure if this is brilliant
   // but hey... at least it works.
   {
@@ -662,6 +1719,409 @@ int main(int argc, char* argv[])
     use_conststdvec(a);
   }
 
+  {
+    std::cout << "Vec with allocators" << std::endl;
+    using namespace rust::prelude;
+    auto v = Vec<int>::with_capacity(8);
+    ASSERT_EQ(v.capacity() >= 8, true);
+    ASSERT_EQ(v.is_empty(), true);
+    v.push(1);
+    v.push(2);
+    ASSERT_EQ(v.len(), 2);
+    ASSERT_EQ(v.pop(), Option<int>(2));
+    const std::vector<int> more{ 3, 4 };
+    v.extend(more);
+    v.extend(rs::iter(more).map([](const auto& x) { return *x * 10; }));
+    const std::vector<int> expected{ 1, 3, 4, 30, 40 };
+    ASSERT_EQ(v, rs::slice(expected));
+    ASSERT_EQ(v.pop(), Option<int>(40));
+    v.clear();
+    ASSERT_EQ(v.pop().is_none(), true);
+
+    // Moving a std::vector in doesn't copy it.
+    std::vector<int> source{ 1, 2, 3 };
+    const int* data = source.data();
+    Vec<int> moved(std::move(source));
+    ASSERT_EQ(moved.as_ptr(), data);
+
+    // collect_in fills an arena, here one that can't fall back to the heap.
+    std::array<std::byte, 1024> buffer;
+    std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size(), std::pmr::null_memory_resource());
+    auto squares = rs::iter(expected).map([](const auto& x) { return *x * *x; }).collect_in(&arena);
+    ASSERT_EQ(squares.len(), 5);
+    ASSERT_EQ(squares[4], 1600);
+    ASSERT_EQ(squares.allocator().resource() == &arena, true);
+    ASSERT_EQ(reinterpret_cast<const std::byte*>(squares.as_ptr()) >= buffer.data(), true);
+    ASSERT_EQ(reinterpret_cast<const std::byte*>(squares.as_ptr()) < buffer.data() + buffer.size(), true);
+    auto copies = rs::iter(expected).collect_in(std::pmr::polymorphic_allocator<int>(&arena));
+    static_assert(std::is_same_v<decltype(copies), Vec<int, std::pmr::polymorphic_allocator<int>>>);
+    ASSERT_EQ(copies, rs::slice(expected));
+
+    auto pmr = rs::iter(expected).copied().collect<Vec<int, std::pmr::polymorphic_allocator<int>>>();
+    ASSERT_EQ(pmr.len(), 5);
+  }
+
+  {
+    std::cout << "Extend and collect_into" << std::endl;
+    using namespace rust::prelude;
+    const std::vector<int> batch{ 1, 2, 3 };
+    std::vector<int> buffer{ 0 };
+    // Contiguous trivially copyable values are appended with one bulk copy.
+    rs::iter(batch).collect_into(buffer);
+    auto& same = rs::iter(batch).map([](const auto& x) { return *x * 10; }).collect_into(buffer);
+    ASSERT_EQ(&same, &buffer);
+    const std::vector<int> expected{ 0, 1, 2, 3, 10, 20, 30 };
+    ASSERT_EQ(rs::slice(buffer), rs::slice(expected));
+
+    auto it = rs::iter(batch);
+    ASSERT_EQ(it.as_slice().len(), 3);
+    it.next();
+    ASSERT_EQ(it.as_slice(), rs::slice(batch)(1, {}));
+
+    // Skipped values are not part of the bulk copy.
+    std::vector<int> tail;
+    rs::iter(batch).skip(1).collect_into(tail);
+    ASSERT_EQ(tail.size(), 2);
+    ASSERT_EQ(tail[0], 2);
+
+    std::string s = "ab";
+    const std::string more = "cd";
+    rs::iter(more).collect_into(s);
+    rs::iter(more).rev().collect_into(s);
+    ASSERT_EQ(s, "abcddc");
+
+    Vec<std::string> names{ "a" };
+    const std::vector<std::string> others{ "b", "c" };
+    rs::iter(others).collect_into(names);
+    ASSERT_EQ(names.len(), 3);
+    ASSERT_EQ(names[2], "c");
+
+    SmallVec<int, 4> small;
+    rs::iter(batch).collect_into(small);
+    ASSERT_EQ(small.len(), 3);
+    HashMap<usize, int> indexed;
+    rs::iter(batch).copied().enumerate().collect_into(indexed);
+    ASSERT_EQ(indexed.get(2).copied(), Option<int>(3));
+
+    // Many batches only reserve what they need, growing geometrically.
+    std::vector<int> log;
+    std::vector<int> mapped_log;
+    usize reallocations = 0;
+    for (int i = 0; i < 100; i++)
+    {
+      rs::iter(batch).collect_into(log);
+      const int* before = mapped_log.data();
+      rs::iter(batch).copied().map([](int x) { return -x; }).collect_into(mapped_log);
+      reallocations += before != mapped_log.data();
+    }
+    ASSERT_EQ(log.size(), 300);
+    ASSERT_EQ(log.capacity() < 600, true);
+    ASSERT_EQ(mapped_log.size(), 300);
+    ASSERT_EQ(reallocations < 10, true);
+  }
+
+  {
+    std::cout << "Vec drain and into_iter" << std::endl;
+    using namespace rust::prelude;
+    Vec<std::string> v{ "a", "b", "c", "d", "e" };
+    {
+      auto d = v.drain(1, 4);
+      ASSERT_EQ(d.len(), 3);
+      ASSERT_EQ(d.next(), Option<std::string>("b"));
+      ASSERT_EQ(d.next_back(), Option<std::string>("d"));
+      // "c" is not yielded, it is dropped together with the iterator.
+    }
+    const std::vector<std::string> expected{ "a", "e" };
+    ASSERT_EQ(v == rs::slice(expected), true);
+
+    Vec<std::string> tail{ "x", "y", "z" };
+    std::vector<std::string> taken = tail.drain(1, {}).collect();
+    ASSERT_EQ(taken.size(), 2);
+    ASSERT_EQ(taken[0], "y");
+    ASSERT_EQ(tail.len(), 1);
+    ASSERT_EQ(tail.drain().count(), 1);
+    ASSERT_EQ(tail.is_empty(), true);
+
+    bool panicked = false;
+    try
+    {
+      v.drain(1, 3);
+    }
+    catch (const rust::panic_error&)
+    {
+      panicked = true;
+    }
+    ASSERT_EQ(panicked, true);
+    ASSERT_EQ(v.len(), 2);
+
+    // Neither into_iter nor drain of an rvalue copy the values.
+    Vec<Counted> counted;
+    for (int i = 0; i < 4; i++)
+    {
+      counted.push(Counted(i));
+    }
+    Counted::clear();
+    auto sum = std::move(counted).into_iter().map([](Counted c) { return c.v; }).sum();
+    ASSERT_EQ(sum, 6);
+    ASSERT_EQ(Counted::copies, 0);
+    std::vector<Counted> records{ Counted(1), Counted(2) };
+    Counted::clear();
+    std::vector<Counted> moved = rs::drain(std::move(records)).collect();
+    ASSERT_EQ(moved.size(), 2);
+    ASSERT_EQ(Counted::copies, 0);
+
+    // The drained range may be moved into other adapters, only the last owner closes the gap.
+    Vec<int> numbers{ 1, 2, 3, 4, 5, 6 };
+    std::vector<int> evens = numbers.drain(0, 4).filter([](const int& x) { return x % 2 == 0; }).collect();
+    ASSERT_EQ(evens.size(), 2);
+    ASSERT_EQ(numbers.len(), 2);
+    ASSERT_EQ(numbers[0], 5);
+  }
+
+  {
+    std::cout << "ArrayVec and SmallVec" << std::endl;
+    using namespace rust::prelude;
+    const std::vector<int> values{ 1, 2, 3, 4, 5 };
+
+    ArrayVec<int, 8> a = rs::iter(values).copied().collect();
+    static_assert(std::is_trivially_copyable_v<ArrayVec<int, 8>>);
+    ASSERT_EQ(a, rs::slice(values));
+    ASSERT_EQ(a.capacity(), 8);
+    a.extend(rs::iter(values).take(3));
+    ASSERT_EQ(a.is_full(), true);
+    ASSERT_EQ(a.try_push(9).is_err(), true);
+    ASSERT_EQ(std::move(a.try_push(9)).unwrap_err(), 9);
+    ASSERT_EQ(a.pop(), Option<int>(3));
+    ASSERT_EQ(a.try_push(9).is_ok(), true);
+    ASSERT_EQ(a.last().copied(), Option<int>(9));
+    ArrayVec<int, 8> copy = a;
+    ASSERT_EQ(copy, a({}, {}));
+
+    // Collecting more than fits panics, unless truncated with take.
+    bool panicked = false;
+    try
+    {
+      ArrayVec<int, 4> too_many = rs::iter(values).copied().collect();
+    }
+    catch (const rust::panic_error&)
+    {
+      panicked = true;
+    }
+    ASSERT_EQ(panicked, true);
+    ArrayVec<int, 4> truncated = rs::iter(values).copied().take(4).collect();
+    ASSERT_EQ(truncated.len(), 4);
+
+    ArrayVec<std::string, 2> strings{ "a" };
+    strings.push("b");
+    ArrayVec<std::string, 2> more_strings = strings;
+    ASSERT_EQ(to_string(more_strings), "[a, b]");
+    ASSERT_EQ(strings.pop(), Option<std::string>("b"));
+
+    SmallVec<int, 4> s = rs::iter(values).copied().take(3).collect();
+    ASSERT_EQ(s.spilled(), false);
+    ASSERT_EQ(s.len(), 3);
+    s.extend(rs::iter(values));
+    ASSERT_EQ(s.spilled(), true);
+    ASSERT_EQ(s.len(), 8);
+    ASSERT_EQ(s[7], 5);
+    const int* data = s.as_ptr();
+    SmallVec<int, 4> stolen = std::move(s);
+    ASSERT_EQ(stolen.as_ptr(), data);
+    ASSERT_EQ(s.is_empty(), true);
+    ASSERT_EQ(s.spilled(), false);
+    s = stolen;
+    ASSERT_EQ(s, stolen({}, {}));
+    ASSERT_NE(s.as_ptr(), stolen.as_ptr());
+
+    SmallVec<std::string, 2> words;
+    for (const auto* w : { "x", "y", "z" })
+    {
+      words.push(w);
+    }
+    ASSERT_EQ(words.spilled(), true);
+    ASSERT_EQ(to_string(words), "[x, y, z]");
+    SmallVec<std::string, 2> inline_words{ "p" };
+    SmallVec<std::string, 2> moved_words = std::move(inline_words);
+    ASSERT_EQ(moved_words.pop(), Option<std::string>("p"));
+    ASSERT_EQ(inline_words.is_empty(), true);
+    const auto reserved = SmallVec<int, 4>::with_capacity(16);
+    ASSERT_EQ(reserved.capacity(), 16);
+  }
+
+  {
+    std::cout << "HashMap and collecting maps" << std::endl;
+    using namespace rust::prelude;
+    const std::vector<std::string> keys{ "a", "b", "c", "a" };
+    const std::vector<int> values{ 1, 2, 3, 4 };
+
+    // Later values win, like inserting them one by one.
+    std::unordered_map<std::string, int> unordered = rs::iter(keys).zip(rs::iter(values)).collect();
+    ASSERT_EQ(unordered.size(), 3);
+    ASSERT_EQ(unordered["a"], 4);
+    std::map<std::string, int> ordered = rs::iter(keys).zip(rs::iter(values)).collect();
+    ASSERT_EQ(ordered.begin()->first, "a");
+    ASSERT_EQ(ordered["a"], 4);
+    std::map<usize, int> by_index = rs::iter(values).copied().enumerate().collect();
+    ASSERT_EQ(by_index[3], 4);
+
+    HashMap<std::string, int> m = rs::iter(keys).zip(rs::iter(values)).collect();
+    ASSERT_EQ(m.len(), 3);
+    ASSERT_EQ(m.get("a").copied(), Option<int>(4));
+    ASSERT_EQ(m.get("z").is_none(), true);
+    ASSERT_EQ(m.insert("d", 5).is_none(), true);
+    ASSERT_EQ(m.insert("d", 6), Option<int>(5));
+    m.get_mut("d").map([](auto v) { *v += 1; });
+    ASSERT_EQ(m.get("d").copied(), Option<int>(7));
+    ASSERT_EQ(m.contains_key("b"), true);
+    ASSERT_EQ(m.remove("b"), Option<int>(2));
+    ASSERT_EQ(m.contains_key("b"), false);
+    ASSERT_EQ(m.remove("b").is_none(), true);
+    ASSERT_EQ(m.len(), 3);
+    ASSERT_EQ(m.iter().len(), 3);
+    ASSERT_EQ(m.values().copied().sum(), 4 + 3 + 7);
+    for (auto kv : m.iter_mut())
+    {
+      *kv.get<1>() *= 10;
+    }
+    ASSERT_EQ(m.get("c").copied(), Option<int>(30));
+
+    // Group by with entry.
+    HashMap<int, int> groups;
+    for (int i = 0; i < 1000; i++)
+    {
+      groups.entry(i % 7).or_insert(0) += i;
+    }
+    ASSERT_EQ(groups.len(), 7);
+    ASSERT_EQ(groups.get(3).copied(), Option<int>(71500));
+    ASSERT_EQ(groups.entry(3).is_occupied(), true);
+    ASSERT_EQ(groups.entry(8).is_occupied(), false);
+    std::move(groups.entry(3)).and_modify([](int& v) { v = -1; }).or_insert(5);
+    ASSERT_EQ(groups.get(3).copied(), Option<int>(-1));
+    ASSERT_EQ(groups.entry(9).or_default(), 0);
+    ASSERT_EQ(groups.len(), 8);
+
+    // Enough inserts and removes to grow, and to reuse tombstones.
+    HashMap<int, std::string> big;
+    for (int i = 0; i < 10000; i++)
+    {
+      big.insert(i, std::to_string(i));
+    }
+    for (int i = 0; i < 10000; i += 2)
+    {
+      ASSERT_EQ(big.remove(i).is_some(), true);
+    }
+    for (int i = 10000; i < 20000; i++)
+    {
+      big.insert(i, std::to_string(i));
+    }
+    ASSERT_EQ(big.len(), 15000);
+    ASSERT_EQ(big.get(9999).copied(), Option<std::string>("9999"));
+    ASSERT_EQ(big.get(9998).is_none(), true);
+    ASSERT_EQ(big.keys().copied().filter([](const int& k) { return k % 2 == 0 && k < 10000; }).count(), 0);
+
+    HashMap<int, std::string> copy = big;
+    big.clear();
+    ASSERT_EQ(big.is_empty(), true);
+    ASSERT_EQ(big.get(19999).is_none(), true);
+    ASSERT_EQ(copy.len(), 15000);
+    ASSERT_EQ(copy.get(19999).copied(), Option<std::string>("19999"));
+    HashMap<int, std::string> moved = std::move(copy);
+    ASSERT_EQ(moved.len(), 15000);
+    ASSERT_EQ(copy.is_empty(), true);
+    copy = moved;
+    ASSERT_EQ(copy.get(1).copied(), Option<std::string>("1"));
+
+    auto reserved = HashMap<int, int>::with_capacity(100);
+    ASSERT_EQ(reserved.capacity() >= 100, true);
+    HashMap<int, int> listed{ { 1, 2 }, { 3, 4 } };
+    ASSERT_EQ(listed.get(3).copied(), Option<int>(4));
+  }
+
+  {
+    std::cout << "Binary encoding" << std::endl;
+    using namespace rust::prelude;
+    Vec<u32> values{ 1, 2, 3, 4 };
+    const auto bytes = rs::to_bytes(values);
+    // A u64 length and four u32 values.
+    ASSERT_EQ(bytes.len(), 8 + 4 * 4);
+    ASSERT_EQ(rs::from_bytes<Vec<u32>>(bytes), values({}, {}));
+
+    // Decoding into a slice aliases the buffer.
+    const auto view = rs::from_bytes<Slice<const u32>>(bytes);
+    ASSERT_EQ(view, values({}, {}));
+    ASSERT_EQ(reinterpret_cast<const u8*>(view.as_ptr()), bytes.as_ptr() + 8);
+
+    // Values are aligned, so the doubles start at offset 16 after a u8 and the length.
+    using Record = Tuple<u8, Slice<const f64>, Option<i32>, Option<i32>, std::string>;
+    const std::vector<f64> doubles{ 0.5, 1.5 };
+    const auto record_bytes = rs::to_bytes(Record(7, rs::slice(doubles), Option<i32>(-3), Option<i32>(), "text"));
+    const auto record = rs::from_bytes<Record>(record_bytes);
+    ASSERT_EQ(record.get<0>(), 7);
+    ASSERT_EQ(record.get<1>(), rs::slice(doubles));
+    ASSERT_EQ(reinterpret_cast<const u8*>(record.get<1>().as_ptr()), record_bytes.as_ptr() + 16);
+    ASSERT_EQ(record.get<2>(), Option<i32>(-3));
+    ASSERT_EQ(record.get<3>().is_none(), true);
+    ASSERT_EQ(record.get<4>(), "text");
+
+    // Nested sequences encode element by element.
+    const std::vector<std::vector<std::string>> nested{ { "a", "bc" }, {}, { "d" } };
+    const auto nested_bytes = rs::to_bytes(nested);
+    const auto decoded = rs::from_bytes<std::vector<std::vector<std::string>>>(nested_bytes);
+    ASSERT_EQ(decoded == nested, true);
+
+    // Views encode what they refer to, not their pointer, and decode aliasing the buffer.
+    const std::string owned_text = "a string longer than the small string buffer";
+    const auto view_bytes = rs::to_bytes(std::string_view(owned_text));
+    ASSERT_EQ(view_bytes.len(), 8 + owned_text.size());
+    const auto text_view = rs::from_bytes<std::string_view>(view_bytes);
+    ASSERT_EQ(text_view == owned_text, true);
+    ASSERT_EQ(reinterpret_cast<const u8*>(text_view.data()), view_bytes.as_ptr() + 8);
+    const std::vector<u32> span_values{ 5, 6, 7 };
+    const auto span_bytes = rs::to_bytes(std::span<const u32>(span_values));
+    ASSERT_EQ(rs::from_bytes<std::span<const u32>>(span_bytes).size(), 3);
+    ASSERT_EQ(rs::from_bytes<Vec<u32>>(span_bytes), rs::slice(span_values));
+    ASSERT_EQ((rs::from_bytes<std::span<const u32, 3>>(span_bytes)[2]), 7);
+
+    // Bools are a checked byte.
+    const std::vector<bool> flags{ true, false, true };
+    const auto flag_bytes = rs::to_bytes(flags);
+    ASSERT_EQ(flag_bytes.len(), 8 + 3);
+    ASSERT_EQ(rs::from_bytes<std::vector<bool>>(flag_bytes) == flags, true);
+
+    // Several values can follow each other in one buffer.
+    std::vector<u8> out;
+    rs::Encoder(out).encode(u16{ 1 }).encode(values).encode(Option<u64>(9));
+    rs::Decoder d(out);
+    ASSERT_EQ(d.decode<u16>(), 1);
+    ASSERT_EQ(d.decode<Slice<const u32>>().len(), 4);
+    ASSERT_EQ(d.decode<Option<u64>>(), Option<u64>(9));
+    ASSERT_EQ(d.is_empty(), true);
+
+    // Truncated and malformed input panics.
+    const auto expect_panic = [](auto f)
+    {
+      try
+      {
+        f();
+      }
+      catch (const rust::panic_error&)
+      {
+        return true;
+      }
+      return false;
+    };
+    const auto truncated = bytes(0, bytes.len() - 1);
+    ASSERT_EQ(expect_panic([&] { rs::from_bytes<Vec<u32>>(truncated); }), true);
+    ASSERT_EQ(expect_panic([&] { rs::from_bytes<u32>(bytes); }), true);
+    std::vector<u8> huge(8, 0xff);
+    ASSERT_EQ(expect_panic([&] { rs::from_bytes<Vec<u32>>(huge); }), true);
+    ASSERT_EQ(expect_panic([&] { rs::from_bytes<std::vector<std::string>>(huge); }), true);
+    const std::vector<u8> bad_tag{ 2 };
+    ASSERT_EQ(expect_panic([&] { rs::from_bytes<Option<u8>>(bad_tag); }), true);
+    ASSERT_EQ(expect_panic([&] { rs::from_bytes<bool>(bad_tag); }), true);
+    ASSERT_EQ(expect_panic([&] { rs::from_bytes<std::span<const u32, 2>>(span_bytes); }), true);
+  }
+
   {
     std::cout << "Map on iter without return" << std::endl;
     using namespace rust::prelude;